@@ -0,0 +1,26 @@
+#include "bench.hpp"
+#include <memory_resource>
+#include <string>
+
+// Compares decoding with the default allocators with decoding into a monotonic arena, which turns the allocations of
+// glyphs, bitmap and scratch buffers into pointer bumps and frees them all at once.
+int main()
+{
+	std::vector<std::byte> arenaBuffer(std::size_t{64} << 20);
+
+	for (const unsigned int size : {256u, 2048u}) {
+		const tref::test::Atlas      atlas{tref::bench::makeAtlas(size)};
+		const std::vector<std::byte> file{tref::test::encode(atlas)};
+		const std::string            name{std::to_string(size) + "x" + std::to_string(size) + ", "};
+
+		tref::bench::report(name + "heap", tref::bench::measure([&] { tref::decode(file); }), atlas.pixels.size());
+
+		const auto decodeInArena{[&] {
+			std::pmr::monotonic_buffer_resource arena{arenaBuffer.data(), arenaBuffer.size()};
+			tref::DecodeOptions                 options;
+			options.memoryResource = &arena;
+			tref::decode(file, options);
+		}};
+		tref::bench::report(name + "arena", tref::bench::measure(decodeInArena), atlas.pixels.size());
+	}
+}
\ No newline at end of file
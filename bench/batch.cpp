@@ -0,0 +1,87 @@
+#include "bench.hpp"
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+	// Drops files from the page cache, so that the next reads come from the disk. Returns false if this isn't
+	// supported.
+	bool evictFromPageCache(std::span<const std::filesystem::path> paths)
+	{
+#ifdef __linux__
+		for (const std::filesystem::path& path : paths) {
+			const int fd{open(path.c_str(), O_RDONLY)};
+			if (fd == -1) {
+				return false;
+			}
+			// Dirty pages can't be dropped, so they are written back first.
+			const bool evicted{fdatasync(fd) == 0 && posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0};
+			close(fd);
+			if (!evicted) {
+				return false;
+			}
+		}
+		return true;
+#else
+		return false;
+#endif
+	}
+} // namespace
+
+// Compares loading a set of files with BatchLoader, which overlaps reads with decoding, with reading each file with
+// std::ifstream and decoding it in turn. Both are measured with a cold page cache, dropping the files from it before
+// each run, which shows how well reads overlap with decoding, and with a warm one, which shows the overhead of the
+// loading paths. The files are written to a directory in the one given as argument, or in the temporary directory,
+// which must not be in memory for the cold cache to make a difference.
+int main(int argc, char** argv)
+{
+	constexpr unsigned int FILE_COUNT{64};
+
+	const std::filesystem::path parent{argc > 1 ? std::filesystem::path{argv[1]}
+												: std::filesystem::temp_directory_path()};
+	const std::filesystem::path directory{parent / "tref_bench_batch"};
+	std::filesystem::create_directories(directory);
+
+	std::vector<std::filesystem::path> paths;
+	std::size_t                        bitmapSize{0};
+	for (unsigned int i = 0; i < FILE_COUNT; ++i) {
+		const tref::test::Atlas      atlas{tref::test::makeAtlas(512, 512, 400, i + 1)};
+		const std::vector<std::byte> file{tref::test::encode(atlas)};
+		paths.push_back(directory / ("font" + std::to_string(i) + ".tref"));
+		std::ofstream{paths.back(), std::ios::binary}.write(reinterpret_cast<const char*>(file.data()),
+															static_cast<std::streamsize>(file.size()));
+		bitmapSize += atlas.pixels.size();
+	}
+
+	const auto sequential{[&] {
+		for (const std::filesystem::path& path : paths) {
+			std::ifstream           is{path, std::ios::binary};
+			const std::vector<char> data{std::istreambuf_iterator<char>{is}, std::istreambuf_iterator<char>{}};
+			tref::decode(std::as_bytes(std::span{data}));
+		}
+	}};
+
+	tref::BatchLoader loader;
+	const std::string batch{loader.usesIoUring() ? "BatchLoader (io_uring)" : "BatchLoader (worker reads)"};
+	const auto        load{[&] { loader.load(paths); }};
+	const auto        evict{[&] { evictFromPageCache(paths); }};
+
+	if (evictFromPageCache(paths)) {
+		tref::bench::report("ifstream + decode, sequential, cold", tref::bench::measureWithSetup(evict, sequential),
+							bitmapSize);
+		tref::bench::report(batch + ", cold", tref::bench::measureWithSetup(evict, load), bitmapSize);
+	}
+	else {
+		std::printf("Dropping files from the page cache isn't supported, only measuring with a warm cache.\n");
+	}
+	tref::bench::report("ifstream + decode, sequential, warm", tref::bench::measure(sequential), bitmapSize);
+	tref::bench::report(batch + ", warm", tref::bench::measure(load), bitmapSize);
+
+	std::filesystem::remove_all(directory);
+}
\ No newline at end of file
@@ -0,0 +1,59 @@
+#pragma once
+#include "test.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace tref::bench {
+	// The number of timed runs of each benchmark.
+	constexpr unsigned int RUNS{15};
+
+	// Generates a large font atlas, with enough glyphs to fill it.
+	inline test::Atlas makeAtlas(unsigned int size = 2048, bool colored = false)
+	{
+		return test::makeAtlas(size, size, (size / 24) * (size / 24), 1, colored);
+	}
+
+	// Gets the median of a non-empty list of times.
+	inline std::chrono::nanoseconds median(std::vector<std::chrono::nanoseconds> times)
+	{
+		std::ranges::nth_element(times, times.begin() + times.size() / 2);
+		return times[times.size() / 2];
+	}
+
+	// Gets the median time taken by a function over a number of runs, after a warm-up run, calling a setup function
+	// before each run without timing it.
+	template <class Setup, class Fn>
+	std::chrono::nanoseconds measureWithSetup(Setup&& setup, Fn&& fn, unsigned int runs = RUNS)
+	{
+		setup();
+		fn();
+
+		std::vector<std::chrono::nanoseconds> times;
+		times.reserve(runs);
+		for (unsigned int i = 0; i < runs; ++i) {
+			setup();
+			const auto start{std::chrono::steady_clock::now()};
+			fn();
+			times.push_back(std::chrono::steady_clock::now() - start);
+		}
+		return median(std::move(times));
+	}
+
+	// Gets the median time taken by a function over a number of runs, after a warm-up run.
+	template <class Fn> std::chrono::nanoseconds measure(Fn&& fn, unsigned int runs = RUNS)
+	{
+		return measureWithSetup([] {}, std::forward<Fn>(fn), runs);
+	}
+
+	// Prints the time taken to process a number of bytes, and the resulting throughput.
+	inline void report(std::string_view name, std::chrono::nanoseconds time, std::size_t bytes)
+	{
+		const double ms{std::chrono::duration<double, std::milli>{time}.count()};
+		std::printf("%-48.*s %10.3f ms %10.1f MB/s\n", static_cast<int>(name.size()), name.data(), ms,
+					static_cast<double>(bytes) / 1000.0 / ms);
+	}
+} // namespace tref::bench
\ No newline at end of file
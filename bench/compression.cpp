@@ -0,0 +1,40 @@
+#include "bench.hpp"
+#include <string>
+
+// Compares the compression modes and levels by encoding time, file size and decoding time. Encoding is timed over
+// fewer runs, as the highest LZ4 HC levels take seconds per run.
+int main()
+{
+	const tref::test::Atlas atlas{tref::bench::makeAtlas()};
+	const tref::BitmapRef   bitmap{atlas.pixels.data(), atlas.width, atlas.height};
+	const std::size_t       bitmapSize{atlas.pixels.size()};
+
+	struct Case {
+		const char*       name;
+		tref::Compression compression;
+		int               level;
+	};
+	constexpr Case cases[]{
+		{"DEFAULT", tref::Compression::DEFAULT, 0},
+		{"FAST 4", tref::Compression::FAST, 4},
+		{"FAST 16", tref::Compression::FAST, 16},
+		{"FAST 64", tref::Compression::FAST, 64},
+		{"HIGH 3", tref::Compression::HIGH, 3},
+		{"HIGH 9", tref::Compression::HIGH, 9},
+		{"HIGH 12", tref::Compression::HIGH, 12},
+	};
+	for (const Case& c : cases) {
+		tref::EncodeOptions options;
+		options.compression = c.compression;
+		options.level       = c.level;
+
+		std::vector<std::byte> file;
+
+		const auto encode{[&] { tref::encodeToBuffer(file, 20, atlas.glyphs, bitmap, options); }};
+		tref::bench::report(std::string{c.name} + ", encode", tref::bench::measure(encode, 5), bitmapSize);
+		tref::bench::report(std::string{c.name} + ", decode", tref::bench::measure([&] { tref::decode(file); }),
+							bitmapSize);
+		std::printf("%-48s %10zu bytes (%.1f%% of the bitmap)\n", "  file size", file.size(),
+					100.0 * static_cast<double>(file.size()) / static_cast<double>(bitmapSize));
+	}
+}
\ No newline at end of file
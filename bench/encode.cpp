@@ -0,0 +1,86 @@
+#include "bench.hpp"
+#include <cstdlib>
+#include <lz4.h>
+#include <sstream>
+#include <string>
+#include <tref/qoi.h>
+#include <utility>
+
+namespace {
+	// Writes a value to a stream as its bytes.
+	template <class T> void writeBinary(std::ostream& os, const T& value)
+	{
+		os.write(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	// Copy of how files were encoded before encoding went through a single buffer, as a baseline: the payload is staged
+	// in a std::ostringstream one glyph at a time, copied out of it, compressed into a buffer of LZ4's worst-case size,
+	// then written to the stream.
+	void encodeStaged(std::ostream& os, std::int32_t lineSkip, const tref::GlyphMap& glyphs,
+					  const tref::BitmapRef& bitmap)
+	{
+		const qoi_desc     desc{bitmap.width, bitmap.height, 4, QOI_SRGB};
+		int                size;
+		void* const        qoi{qoi_encode(bitmap.data, &desc, &size)};
+		std::ostringstream buffer{std::ios::binary};
+		writeBinary(buffer, lineSkip);
+		writeBinary(buffer, static_cast<std::uint32_t>(glyphs.size()));
+		for (const auto& [cp, glyph] : glyphs) {
+			writeBinary(buffer, cp);
+			writeBinary(buffer, glyph);
+		}
+		buffer.write(static_cast<const char*>(qoi), size);
+		std::free(qoi);
+
+		const std::string      raw{std::move(buffer).str()};
+		std::vector<std::byte> lz4(LZ4_compressBound(static_cast<int>(raw.size())));
+		lz4.resize(LZ4_compress_default(raw.c_str(), reinterpret_cast<char*>(lz4.data()), static_cast<int>(raw.size()),
+										static_cast<int>(lz4.size())));
+
+		os.write("TREF", 4);
+		writeBinary(os, static_cast<std::uint32_t>(raw.size()));
+		os.write(reinterpret_cast<const char*>(lz4.data()), static_cast<std::streamsize>(lz4.size()));
+	}
+} // namespace
+
+// Compares encoding to a stream with encoding into a reused buffer and to a callback, for untiled and tiled files,
+// against encoding untiled files the way it was done before encoding went through a single buffer.
+int main()
+{
+	const tref::test::Atlas atlas{tref::bench::makeAtlas()};
+	const tref::BitmapRef   bitmap{atlas.pixels.data(), atlas.width, atlas.height};
+	const std::size_t       bitmapSize{atlas.pixels.size()};
+
+	for (const auto& [layout, options] : {std::pair{"untiled", tref::EncodeOptions{}},
+										  std::pair{"256x256 tiles", tref::EncodeOptions{256, 256}}}) {
+		const std::string name{layout};
+
+		if (options.tileWidth == 0) {
+			const auto encodeToStreamStaged{[&] {
+				std::ostringstream os{std::ios::binary};
+				encodeStaged(os, 20, atlas.glyphs, bitmap);
+			}};
+			tref::bench::report(name + ", ostringstream, staged (baseline)", tref::bench::measure(encodeToStreamStaged),
+								bitmapSize);
+		}
+
+		const auto encodeToStream{[&] {
+			std::ostringstream os{std::ios::binary};
+			tref::encode(os, 20, atlas.glyphs, bitmap, options);
+		}};
+		tref::bench::report(name + ", ostringstream", tref::bench::measure(encodeToStream), bitmapSize);
+
+		std::vector<std::byte> buffer;
+
+		const auto encodeToBuffer{[&] { tref::encodeToBuffer(buffer, 20, atlas.glyphs, bitmap, options); }};
+		tref::bench::report(name + ", reused buffer", tref::bench::measure(encodeToBuffer), bitmapSize);
+
+		std::size_t written{0};
+
+		const auto encodeToCallback{[&] {
+			tref::encode([&](std::span<const std::byte> data) { written += data.size(); }, 20, atlas.glyphs, bitmap,
+						 options);
+		}};
+		tref::bench::report(name + ", callback", tref::bench::measure(encodeToCallback), bitmapSize);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,36 @@
+#include "bench.hpp"
+
+// Compares decoding a file at once with decoding it in steps of various budgets, and reports the longest step,
+// which bounds how long a frame waits on the decoder.
+int main()
+{
+	const tref::test::Atlas      atlas{tref::bench::makeAtlas()};
+	const std::vector<std::byte> file{tref::test::encode(atlas)};
+	const std::size_t            bitmapSize{atlas.pixels.size()};
+
+	tref::bench::report("decode", tref::bench::measure([&] { tref::decode(file); }), bitmapSize);
+
+	const std::pair<const char*, tref::StepBudget> budgets[]{
+		{"IncrementalDecoder, default budget", {}},
+		{"IncrementalDecoder, 16 KiB/256 glyphs/16 rows", {16 * 1024, 256, 16}},
+		{"IncrementalDecoder, 1 KiB/16 glyphs/1 row", {1024, 16, 1}},
+	};
+	for (const auto& [name, budget] : budgets) {
+		std::vector<std::chrono::nanoseconds> longestSteps;
+
+		const auto decodeInSteps{[&] {
+			tref::IncrementalDecoder decoder{file};
+			std::chrono::nanoseconds longestStep{0};
+			for (bool done = false; !done;) {
+				const auto start{std::chrono::steady_clock::now()};
+				done = decoder.step(budget).done;
+				longestStep = std::max<std::chrono::nanoseconds>(longestStep, std::chrono::steady_clock::now() - start);
+			}
+			decoder.result();
+			longestSteps.push_back(longestStep);
+		}};
+		tref::bench::report(name, tref::bench::measure(decodeInSteps), bitmapSize);
+		std::printf("%-48s %10.3f ms\n", "  longest step (median of runs)",
+					std::chrono::duration<double, std::milli>{tref::bench::median(longestSteps)}.count());
+	}
+}
\ No newline at end of file
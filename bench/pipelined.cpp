@@ -0,0 +1,23 @@
+#include "bench.hpp"
+#include <string>
+#include <utility>
+
+// Compares decoding the glyph table and bitmap one after the other with decoding them concurrently, for untiled and
+// tiled files.
+int main()
+{
+	const tref::test::Atlas atlas{tref::bench::makeAtlas()};
+	const std::size_t       bitmapSize{atlas.pixels.size()};
+
+	tref::DecodeOptions pipelined;
+	pipelined.pipelined = true;
+
+	for (const auto& [layout, encodeOptions] : {std::pair{"untiled", tref::EncodeOptions{}},
+												std::pair{"256x256 tiles", tref::EncodeOptions{256, 256}}}) {
+		const std::vector<std::byte> file{tref::test::encode(atlas, encodeOptions)};
+		const std::string            name{layout};
+		tref::bench::report(name + ", serial", tref::bench::measure([&] { tref::decode(file); }), bitmapSize);
+		tref::bench::report(name + ", pipelined", tref::bench::measure([&] { tref::decode(file, pipelined); }),
+							bitmapSize);
+	}
+}
\ No newline at end of file
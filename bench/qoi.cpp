@@ -0,0 +1,171 @@
+#include "../src/common.hpp"
+#include "bench.hpp"
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+
+namespace {
+	// Kinds of QOI chunks, looked up from their first byte by the table-driven decoder.
+	enum class Op : std::uint8_t {
+		INDEX,
+		DIFF,
+		LUMA,
+		RUN,
+		RGB,
+		RGBA
+	};
+
+	// Table of the kind of chunk starting with each byte.
+	constexpr std::array<Op, 256> OPS{[] {
+		std::array<Op, 256> ops{};
+		for (unsigned int b1 = 0; b1 < 256; ++b1) {
+			ops[b1] = b1 == 0xff ? Op::RGBA : b1 == 0xfe ? Op::RGB : static_cast<Op>(b1 >> 6);
+		}
+		return ops;
+	}()};
+
+	// Decodes QOI chunk data into pixels by dispatching on a table of chunk kinds with a switch, the alternative to the
+	// ordered comparisons of QoiDecoder. It writes runs like QoiDecoder, but doesn't support resuming.
+	void decodeTableDriven(const std::uint8_t* bytes, const std::uint8_t* end, std::uint8_t* out, std::size_t count)
+	{
+		struct Rgba {
+			std::uint8_t r, g, b, a;
+		};
+		std::array<Rgba, 64> index{};
+		Rgba                 px{0, 0, 0, 255};
+
+		const auto hash{[](Rgba px) { return (px.r * 3 + px.g * 5 + px.b * 7 + px.a * 11) % 64; }};
+		const auto fill{[&](std::size_t n) {
+			for (std::size_t i = 0; i < n; ++i) {
+				std::memcpy(out + i * 4, &px, 4);
+			}
+		}};
+
+		const std::uint8_t* const outEnd{out + count * 4};
+		while (bytes < end) {
+			const bool        fast{static_cast<std::size_t>(end - bytes) >= 5 &&
+							   static_cast<std::size_t>(outEnd - out) >= 64 * 4};
+			const std::uint8_t b1{*bytes++};
+			std::size_t        run{1};
+			switch (OPS[b1]) {
+			case Op::INDEX:
+				px = index[b1];
+				break;
+			case Op::DIFF:
+				px.r += ((b1 >> 4) & 0x03) - 2;
+				px.g += ((b1 >> 2) & 0x03) - 2;
+				px.b += (b1 & 0x03) - 2;
+				break;
+			case Op::LUMA: {
+				const int b2{*bytes++};
+				const int vg{(b1 & 0x3f) - 32};
+				px.r += vg - 8 + ((b2 >> 4) & 0x0f);
+				px.g += vg;
+				px.b += vg - 8 + (b2 & 0x0f);
+				break;
+			}
+			case Op::RUN:
+				run = (b1 & 0x3f) + 1;
+				break;
+			case Op::RGB:
+				px = {bytes[0], bytes[1], bytes[2], px.a};
+				bytes += 3;
+				break;
+			case Op::RGBA:
+				px = {bytes[0], bytes[1], bytes[2], bytes[3]};
+				bytes += 4;
+				break;
+			}
+			index[hash(px)] = px;
+
+			if (fast) {
+				fill(run == 1 ? 1 : 64);
+			}
+			else {
+				run = std::min<std::size_t>(run, (outEnd - out) / 4);
+				fill(run);
+			}
+			out += run * 4;
+			if (out == outEnd) {
+				return;
+			}
+		}
+		fill((outEnd - out) / 4);
+	}
+} // namespace
+
+// Compares decoding QOI images with the reference qoi_decode, with QoiDecoder and with a table-driven variant of it,
+// for atlases whose pixels favor different chunk types: mostly runs for a sparse atlas, index and diff chunks for
+// glyphs with varying alpha, and RGBA chunks for colored glyphs. The time spent decoding QOI data when decoding a
+// whole file, as reported by DecodeStats, is shown as well.
+int main()
+{
+	// The speedup over qoi_decode that QoiDecoder is aiming for.
+	constexpr double TARGET_SPEEDUP{2.0};
+
+	struct Case {
+		const char*       name;
+		tref::test::Atlas atlas;
+	};
+	const Case cases[]{
+		{"sparse", tref::test::makeAtlas(2048, 2048, 500)},
+		{"full, alpha only", tref::bench::makeAtlas()},
+		{"full, colored", tref::bench::makeAtlas(2048, true)},
+	};
+
+	for (const Case& c : cases) {
+		const std::string name{c.name};
+		const std::size_t bitmapSize{c.atlas.pixels.size()};
+		const std::size_t pixelCount{std::size_t{c.atlas.width} * c.atlas.height};
+
+		const qoi_desc desc{c.atlas.width, c.atlas.height, 4, QOI_SRGB};
+		int            qoiSize;
+		void* const    qoi{qoi_encode(c.atlas.pixels.data(), &desc, &qoiSize)};
+		const auto*    chunks{static_cast<const std::byte*>(qoi) + tref::detail::QOI_HEADER_BYTES};
+		const auto*    chunksEnd{static_cast<const std::byte*>(qoi) + qoiSize - tref::detail::QOI_END_MARKER_BYTES};
+
+		const auto decodeReference{[&] {
+			qoi_desc decodedDesc;
+			std::free(qoi_decode(qoi, qoiSize, &decodedDesc, 4));
+		}};
+		const std::chrono::nanoseconds reference{tref::bench::measure(decodeReference)};
+		tref::bench::report(name + ", qoi_decode (reference)", reference, bitmapSize);
+
+		// Like qoi_decode, the other decoders allocate their output for every image, without initializing it.
+		const auto decodeTable{[&] {
+			const auto pixels{std::make_unique_for_overwrite<std::uint8_t[]>(bitmapSize)};
+			decodeTableDriven(reinterpret_cast<const std::uint8_t*>(chunks),
+							  reinterpret_cast<const std::uint8_t*>(chunksEnd), pixels.get(), pixelCount);
+		}};
+		tref::bench::report(name + ", table-driven dispatch", tref::bench::measure(decodeTable), bitmapSize);
+
+		const auto decodeOrdered{[&] {
+			const auto               pixels{std::make_unique_for_overwrite<std::byte[]>(bitmapSize)};
+			tref::detail::QoiDecoder decoder;
+			const std::byte*         it{chunks};
+			decoder.decode(it, chunksEnd, pixels.get(), pixelCount);
+		}};
+		const std::chrono::nanoseconds ordered{tref::bench::measure(decodeOrdered)};
+		tref::bench::report(name + ", QoiDecoder", ordered, bitmapSize);
+
+		const double speedup{static_cast<double>(reference.count()) / static_cast<double>(ordered.count())};
+		std::printf("%-48s %10.2fx%s\n", "  speedup over qoi_decode", speedup,
+					speedup < TARGET_SPEEDUP ? " (short of the 2x target)" : "");
+		std::free(qoi);
+
+		const std::vector<std::byte>          file{tref::test::encode(c.atlas)};
+		std::vector<std::chrono::nanoseconds> qoiTimes;
+
+		const auto decode{[&] {
+			tref::DecodeStats   stats;
+			tref::DecodeOptions options;
+			options.stats = &stats;
+			tref::decode(file, options);
+			qoiTimes.push_back(stats.qoiTime);
+		}};
+		tref::bench::report(name + ", decode", tref::bench::measure(decode), bitmapSize);
+		tref::bench::report(name + ", QOI time in decode", tref::bench::median(qoiTimes), bitmapSize);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,27 @@
+#include "bench.hpp"
+#include <string>
+#include <thread>
+
+// Measures how decoding a bitmap stored as horizontal stripes scales with the number of threads, against the same
+// bitmap stored untiled.
+int main()
+{
+	const tref::test::Atlas atlas{tref::bench::makeAtlas()};
+	const std::size_t       bitmapSize{atlas.pixels.size()};
+
+	const std::vector<std::byte> untiled{tref::test::encode(atlas)};
+	tref::bench::report("untiled", tref::bench::measure([&] { tref::decode(untiled); }), bitmapSize);
+
+	const std::vector<std::byte> striped{tref::test::encode(atlas, tref::EncodeOptions{0, 64})};
+	const unsigned int           maxThreads{std::max(std::thread::hardware_concurrency(), 1u)};
+	for (unsigned int threads = 1;; threads = std::min(threads * 2, maxThreads)) {
+		tref::DecodeOptions options;
+		options.threads = threads;
+
+		const std::string name{"64-row stripes, " + std::to_string(threads) + " thread(s)"};
+		tref::bench::report(name, tref::bench::measure([&] { tref::decode(striped, options); }), bitmapSize);
+		if (threads == maxThreads) {
+			break;
+		}
+	}
+}
\ No newline at end of file
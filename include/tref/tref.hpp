@@ -1,10 +1,23 @@
 #pragma once
+#include <chrono>
+#include <coroutine>
 #include <cstddef>
 #include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <functional>
+#include <future>
 #include <iostream>
+#include <limits>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <optional>
 #include <span>
 #include <stdexcept>
+#include <stop_token>
 #include <unordered_map>
+#include <vector>
 
 /**********************************************************************************************************************
  * Namespace containing all tref functionality.
@@ -51,32 +64,158 @@ namespace tref {
 
 	/******************************************************************************************************************
 	 * Shorthand for a collection of glyphs with associated codepoints.
+	 *
+	 * The collection uses a polymorphic allocator, so that decoded glyphs can be placed in
+	 * DecodeOptions::memoryResource.
+	 ******************************************************************************************************************/
+	using GlyphMap = std::pmr::unordered_map<Codepoint, Glyph>;
+
+	/******************************************************************************************************************
+	 * Inclusive range of codepoints.
+	 ******************************************************************************************************************/
+	struct CodepointRange {
+		/**************************************************************************************************************
+		 * The first codepoint in the range.
+		 **************************************************************************************************************/
+		Codepoint first;
+
+		/**************************************************************************************************************
+		 * The last codepoint in the range.
+		 **************************************************************************************************************/
+		Codepoint last;
+	};
+
+	/******************************************************************************************************************
+	 * Rectangular region of a bitmap.
+	 ******************************************************************************************************************/
+	struct Rect {
+		/**************************************************************************************************************
+		 * The top-left corner of the region.
+		 **************************************************************************************************************/
+		unsigned int x, y;
+
+		/**************************************************************************************************************
+		 * The size of the region.
+		 **************************************************************************************************************/
+		unsigned int width, height;
+
+		friend constexpr bool operator==(const Rect&, const Rect&) noexcept = default;
+	};
+
+	/******************************************************************************************************************
+	 * Gets the union of the texture boxes of a collection of glyphs.
+	 *
+	 * Glyphs with an empty texture box are ignored.
+	 *
+	 * @param[in] glyphs The glyphs.
+	 *
+	 * @return The bounding box of the glyphs, or an empty region at (0, 0) if no glyph has a texture box.
+	 ******************************************************************************************************************/
+	Rect glyphBounds(const GlyphMap& glyphs) noexcept;
+
+	/******************************************************************************************************************
+	 * Pixel format of decoded bitmaps.
+	 ******************************************************************************************************************/
+	enum class PixelFormat : std::uint8_t {
+		/**************************************************************************************************************
+		 * 32bpp RGBA.
+		 **************************************************************************************************************/
+		RGBA8,
+
+		/**************************************************************************************************************
+		 * 32bpp BGRA.
+		 **************************************************************************************************************/
+		BGRA8,
+
+		/**************************************************************************************************************
+		 * 8bpp alpha (coverage) only.
+		 **************************************************************************************************************/
+		A8,
+
+		/**************************************************************************************************************
+		 * 32bpp RGBA with the color channels premultiplied by alpha.
+		 **************************************************************************************************************/
+		PREMULTIPLIED_RGBA8
+	};
+
+	/******************************************************************************************************************
+	 * Gets the size of a pixel in a given format.
+	 *
+	 * @param[in] format The pixel format.
+	 *
+	 * @return The size of a pixel in bytes.
 	 ******************************************************************************************************************/
-	using GlyphMap = std::unordered_map<Codepoint, Glyph>;
+	constexpr std::size_t bytesPerPixel(PixelFormat format) noexcept
+	{
+		return format == PixelFormat::A8 ? 1 : 4;
+	}
 
 	/******************************************************************************************************************
 	 * Simple bitmap class used for output.
+	 *
+	 * The bitmap owns its data, so it can be moved but not copied.
 	 ******************************************************************************************************************/
 	class DecodedBitmap {
 	  public:
+		/**************************************************************************************************************
+		 * Function freeing bitmap data.
+		 **************************************************************************************************************/
+		using Deleter = std::function<void(std::byte*)>;
+
 		/**************************************************************************************************************
 		 * Constructs a bitmap from existing data.
 		 *
 		 * @param data The bitmap data.
 		 * @param width The bitmap width.
 		 * @param height The bitmap height.
+		 * @param format The bitmap pixel format.
+		 * @param resource The memory resource the data was allocated from with an alignment of
+		 * alignof(std::max_align_t), or nullptr if it was allocated with std::malloc.
+		 **************************************************************************************************************/
+		DecodedBitmap(std::byte* data, unsigned int width, unsigned int height, PixelFormat format = PixelFormat::RGBA8,
+					  std::pmr::memory_resource* resource = nullptr) noexcept;
+
+		/**************************************************************************************************************
+		 * Constructs a bitmap from existing data freed by a custom deleter.
+		 *
+		 * @param data The bitmap data.
+		 * @param width The bitmap width.
+		 * @param height The bitmap height.
+		 * @param format The bitmap pixel format.
+		 * @param deleter The function called to free the data if it isn't null.
+		 **************************************************************************************************************/
+		DecodedBitmap(std::byte* data, unsigned int width, unsigned int height, PixelFormat format,
+					  Deleter deleter) noexcept;
+
+		DecodedBitmap(const DecodedBitmap&) = delete;
+
+		/**************************************************************************************************************
+		 * Move-constructs a bitmap.
+		 *
+		 * @param[in] r The bitmap to move from. It is left empty.
 		 **************************************************************************************************************/
-		DecodedBitmap(std::byte* data, unsigned int width, unsigned int height) noexcept;
+		DecodedBitmap(DecodedBitmap&& r) noexcept;
 
 		/**************************************************************************************************************
 		 * Deallocates the bitmap.
 		 **************************************************************************************************************/
 		~DecodedBitmap() noexcept;
 
+		/**************************************************************************************************************
+		 * Move-assigns a bitmap.
+		 *
+		 * @param[in] r The bitmap to move from. It is left empty.
+		 *
+		 * @return A reference to the assigned bitmap.
+		 **************************************************************************************************************/
+		DecodedBitmap& operator=(DecodedBitmap&& r) noexcept;
+
+		DecodedBitmap& operator=(const DecodedBitmap&) = delete;
+
 		/**************************************************************************************************************
 		 * Gets the bitmap's data.
 		 *
-		 * @return The bitmap's data. The data is encoded in 32bbp RGBA format.
+		 * @return The bitmap's data, encoded in the bitmap's pixel format.
 		 **************************************************************************************************************/
 		std::span<const std::byte> data() const noexcept;
 
@@ -94,10 +233,59 @@ namespace tref {
 		 **************************************************************************************************************/
 		unsigned int height() const noexcept;
 
+		/**************************************************************************************************************
+		 * Gets the bitmap's pixel format.
+		 *
+		 * @return The bitmap's pixel format.
+		 **************************************************************************************************************/
+		PixelFormat format() const noexcept;
+
+		/**************************************************************************************************************
+		 * Gets the function that frees the bitmap's data.
+		 *
+		 * This is std::free unless the bitmap was constructed with a memory resource or a custom deleter. It must be
+		 * obtained before calling release(), which forgets how the data was allocated.
+		 *
+		 * @return The function that frees the bitmap's data.
+		 **************************************************************************************************************/
+		Deleter deleter() const;
+
+		/**************************************************************************************************************
+		 * Releases ownership of the bitmap's data, leaving the bitmap empty.
+		 *
+		 * This allows the pixels to be adopted by another bitmap type without copying them.
+		 *
+		 * @return The bitmap's data, which must be freed with the function returned by deleter().
+		 **************************************************************************************************************/
+		std::byte* release() noexcept;
+
+		/**************************************************************************************************************
+		 * Changes the bitmap's size and pixel format, keeping its data if it's large enough.
+		 *
+		 * Otherwise, new data is allocated from a memory resource, or with std::malloc if it's null, and the old data
+		 * is freed. The pixel values are unspecified afterwards either way.
+		 *
+		 * @exception std::bad_alloc If allocating the new data fails, in which case the bitmap is left unchanged.
+		 *
+		 * @param width The new bitmap width.
+		 * @param height The new bitmap height.
+		 * @param format The new bitmap pixel format.
+		 * @param resource The memory resource to allocate new data from with an alignment of alignof(std::max_align_t),
+		 * or nullptr to allocate it with std::malloc.
+		 *
+		 * @return The bitmap's data, which may be written to.
+		 **************************************************************************************************************/
+		std::span<std::byte> resize(unsigned int width, unsigned int height, PixelFormat format,
+									std::pmr::memory_resource* resource = nullptr);
+
 	  private:
-		std::byte*   _data;
-		unsigned int _width;
-		unsigned int _height;
+		std::byte*                 _data;
+		unsigned int               _width;
+		unsigned int               _height;
+		PixelFormat                _format;
+		std::pmr::memory_resource* _resource;
+		Deleter                    _deleter;
+		std::size_t                _capacity;
 	};
 
 	/******************************************************************************************************************
@@ -107,6 +295,20 @@ namespace tref {
 		using runtime_error::runtime_error;
 	};
 
+	/******************************************************************************************************************
+	 * Error thrown when decoding a tref file would exceed one of the limits set in DecodeOptions.
+	 ******************************************************************************************************************/
+	struct LimitError : DecodingError {
+		using DecodingError::DecodingError;
+	};
+
+	/******************************************************************************************************************
+	 * Error thrown when decoding a tref file is cancelled through DecodeOptions::stopToken.
+	 ******************************************************************************************************************/
+	struct CancellationError : std::runtime_error {
+		using runtime_error::runtime_error;
+	};
+
 	/******************************************************************************************************************
 	 * tref file decoding result.
 	 ******************************************************************************************************************/
@@ -128,51 +330,1204 @@ namespace tref {
 	};
 
 	/******************************************************************************************************************
-	 * Decodes a tref file from a data span.
-	 *
-	 * @exception DecodingError If decoding the data fails.
+	 * Interface used to run libtref work on a user-provided thread pool or job system.
+	 ******************************************************************************************************************/
+	class Executor {
+	  public:
+		/**************************************************************************************************************
+		 * Destroys the executor.
+		 **************************************************************************************************************/
+		virtual ~Executor() = default;
+
+		/**************************************************************************************************************
+		 * Schedules a task to be run, possibly on another thread.
+		 *
+		 * The task may be run at any later point, but this function must not wait for it to be run.
+		 *
+		 * @param[in] task The task to run.
+		 **************************************************************************************************************/
+		virtual void execute(std::function<void()> task) = 0;
+	};
+
+	/******************************************************************************************************************
+	 * Interface receiving the stages of decoding and encoding, for example to show them on a profiling timeline.
 	 *
-	 * @param[in] data The input data.
+	 * The stages are "header read", "LZ4 decompress", "glyph table" and "QOI decode" when decoding, and "glyph table",
+	 * "QOI encode" and "LZ4 compress" when encoding. A stage ends on the thread it began on, but several stages may be
+	 * running at once on different threads if decoding is done on several threads.
+	 ******************************************************************************************************************/
+	class TraceSink {
+	  public:
+		/**************************************************************************************************************
+		 * Destroys the sink.
+		 **************************************************************************************************************/
+		virtual ~TraceSink() = default;
+
+		/**************************************************************************************************************
+		 * Called when a stage begins on the calling thread.
+		 *
+		 * @param[in] stage The name of the stage, a string literal.
+		 **************************************************************************************************************/
+		virtual void begin(const char* stage) noexcept = 0;
+
+		/**************************************************************************************************************
+		 * Called when the last stage begun on the calling thread ends.
+		 *
+		 * @param[in] stage The name of the stage, a string literal.
+		 **************************************************************************************************************/
+		virtual void end(const char* stage) noexcept = 0;
+	};
+
+	/******************************************************************************************************************
+	 * Trace sink writing the stages to a file in the Chrome trace event format, which can be opened in
+	 * chrome://tracing or Perfetto.
 	 *
-	 * @return The font information.
+	 * The sink is thread-safe, and can be shared by any number of decoding and encoding calls.
 	 ******************************************************************************************************************/
-	DecodingResult decode(std::span<const std::byte> data);
+	class ChromeTraceSink : public TraceSink {
+	  public:
+		/**************************************************************************************************************
+		 * Creates a sink writing to a file.
+		 *
+		 * @exception FileError If opening the file fails.
+		 *
+		 * @param[in] path The path to the trace file, which is overwritten.
+		 **************************************************************************************************************/
+		explicit ChromeTraceSink(const std::filesystem::path& path);
 
-	///
+		/**************************************************************************************************************
+		 * Finishes and closes the trace file.
+		 **************************************************************************************************************/
+		~ChromeTraceSink() noexcept override;
+
+		/**************************************************************************************************************
+		 * Writes an event marking the beginning of a stage on the calling thread.
+		 *
+		 * @param[in] stage The name of the stage, a string literal.
+		 **************************************************************************************************************/
+		void begin(const char* stage) noexcept override;
+
+		/**************************************************************************************************************
+		 * Writes an event marking the end of a stage on the calling thread.
+		 *
+		 * @param[in] stage The name of the stage, a string literal.
+		 **************************************************************************************************************/
+		void end(const char* stage) noexcept override;
+
+	  private:
+		struct Impl;
+
+		std::unique_ptr<Impl> _impl;
+	};
 
 	/******************************************************************************************************************
-	 * Struct containing data about the bitmap to encode into a tref file.
+	 * Statistics about decoding a tref file, collected through DecodeOptions::stats.
+	 *
+	 * Stage times are wall-clock times, summed over threads when a stage is run on several of them.
 	 ******************************************************************************************************************/
-	struct BitmapRef {
+	struct DecodeStats {
 		/**************************************************************************************************************
-		 * Pointer to the beginning of the bitmap data.
+		 * The size of the file data read in bytes. StreamDecoder stops reading once the bitmap is complete, which may be
+		 * before the end of the file.
 		 **************************************************************************************************************/
-		const std::byte* data;
+		std::size_t fileSize{0};
 
 		/**************************************************************************************************************
-		 * The size of the bitmap.
+		 * The size of the decompressed payload in bytes.
 		 **************************************************************************************************************/
-		unsigned int width, height;
+		std::size_t decompressedSize{0};
+
+		/**************************************************************************************************************
+		 * The size of the output bitmap in bytes.
+		 **************************************************************************************************************/
+		std::size_t bitmapSize{0};
+
+		/**************************************************************************************************************
+		 * The number of glyphs output.
+		 **************************************************************************************************************/
+		std::size_t glyphCount{0};
+
+		/**************************************************************************************************************
+		 * The number of allocations made for the output bitmap and scratch buffers.
+		 *
+		 * Scratch buffers passed by the caller and the nodes of the glyph map aren't counted.
+		 **************************************************************************************************************/
+		std::size_t allocations{0};
+
+		/**************************************************************************************************************
+		 * The time spent decompressing the payload or tiles.
+		 **************************************************************************************************************/
+		std::chrono::nanoseconds lz4Time{0};
+
+		/**************************************************************************************************************
+		 * The time spent reading the glyph table, including its decompression in tiled files.
+		 **************************************************************************************************************/
+		std::chrono::nanoseconds glyphTime{0};
+
+		/**************************************************************************************************************
+		 * The time spent decoding the QOI image data.
+		 **************************************************************************************************************/
+		std::chrono::nanoseconds qoiTime{0};
 	};
 
 	/******************************************************************************************************************
-	 * Error thrown when encoding a tref file fails.
+	 * Options controlling how a tref file is decoded.
 	 ******************************************************************************************************************/
-	struct EncodingError : std::runtime_error {
-		using runtime_error::runtime_error;
+	struct DecodeOptions {
+		/**************************************************************************************************************
+		 * The pixel format of the decoded bitmap.
+		 *
+		 * Conversion from the stored RGBA data is done while decoding, without an extra pass over the bitmap.
+		 **************************************************************************************************************/
+		PixelFormat outputFormat{PixelFormat::RGBA8};
+
+		/**************************************************************************************************************
+		 * The ranges of codepoints to decode glyphs for.
+		 *
+		 * If empty, glyphs are decoded regardless of codepoint.
+		 **************************************************************************************************************/
+		std::span<const CodepointRange> codepoints{};
+
+		/**************************************************************************************************************
+		 * Predicate selecting the codepoints to decode glyphs for.
+		 *
+		 * If set, only glyphs for which it returns true (and which are within @ref codepoints) are decoded.
+		 **************************************************************************************************************/
+		std::function<bool(Codepoint)> glyphFilter{};
+
+		/**************************************************************************************************************
+		 * Whether to crop the bitmap to the bounding box of the decoded glyphs.
+		 *
+		 * If set, the decoded bitmap only covers glyphBounds() of the decoded glyphs, the texture boxes of the glyphs
+		 * are made relative to it, and rows of the stored bitmap below it are never decoded. Glyphs with an empty
+		 * texture box are moved to (0, 0).
+		 **************************************************************************************************************/
+		bool cropBitmap{false};
+
+		/**************************************************************************************************************
+		 * The number of threads used to decode tiled bitmaps, including the calling thread.
+		 *
+		 * The other threads are taken from the thread pool shared by the library, so no more than one per hardware
+		 * thread is used. Rows of tiles are decoded in parallel when decoding into a buffer, see EncodeOptions.
+		 * Horizontal stripes (tiles with a tile width of 0) are the layout that parallelizes best. Ignored if
+		 * @ref executor is set.
+		 **************************************************************************************************************/
+		unsigned int threads{1};
+
+		/**************************************************************************************************************
+		 * Executor used to decode tiled bitmaps in parallel with the calling thread instead of the thread pool shared
+		 * by the library, also used by @ref pipelined.
+		 **************************************************************************************************************/
+		Executor* executor{nullptr};
+
+		/**************************************************************************************************************
+		 * Whether to build the glyph table concurrently with the bitmap being decoded.
+		 *
+		 * The glyph table is built on @ref executor if set, or on the thread pool shared by the library otherwise,
+		 * while the bitmap is decoded on the calling thread, so @ref glyphFilter may be called from another thread.
+		 * Ignored if @ref cropBitmap is set, as the cropped region depends on the glyph table, and by StreamDecoder.
+		 *
+		 * Files without tiles are decompressed as a stream, with glyphs handed over to the other thread as soon as
+		 * they are decompressed and the bitmap decoded as the rest of the payload is, so the decompressed payload is
+		 * never held in memory as a whole.
+		 **************************************************************************************************************/
+		bool pipelined{false};
+
+		/**************************************************************************************************************
+		 * Stop token used to cancel decoding.
+		 *
+		 * The token is checked between decoding stages and regularly while the bitmap is decoded. If a stop was
+		 * requested, decoding throws CancellationError.
+		 **************************************************************************************************************/
+		std::stop_token stopToken{};
+
+		/**************************************************************************************************************
+		 * Maximum size of the decompressed payload of a file in bytes.
+		 *
+		 * Like the other limits, this is checked before anything is allocated for the data it bounds, and decoding
+		 * throws LimitError if it is exceeded.
+		 **************************************************************************************************************/
+		std::size_t maxDecompressedSize{std::numeric_limits<std::size_t>::max()};
+
+		/**************************************************************************************************************
+		 * Maximum number of pixels of the stored bitmap.
+		 **************************************************************************************************************/
+		std::uint64_t maxBitmapPixels{std::numeric_limits<std::uint64_t>::max()};
+
+		/**************************************************************************************************************
+		 * Maximum number of glyphs stored in a file, including those filtered out.
+		 **************************************************************************************************************/
+		std::uint32_t maxGlyphCount{std::numeric_limits<std::uint32_t>::max()};
+
+		/**************************************************************************************************************
+		 * Memory resource backing the decoded glyphs and bitmap and the scratch buffers used while decoding.
+		 *
+		 * If not set, the glyphs and scratch buffers use the default memory resource, and the bitmap is allocated
+		 * with std::malloc. Scratch buffers passed by the caller are not affected. If decoding is done on several
+		 * threads (see @ref threads, @ref executor and @ref pipelined), the resource must be thread-safe, for example
+		 * std::pmr::synchronized_pool_resource.
+		 **************************************************************************************************************/
+		std::pmr::memory_resource* memoryResource{nullptr};
+
+		/**************************************************************************************************************
+		 * Statistics filled in by decoding, or nullptr to not collect any.
+		 *
+		 * The statistics are reset when decoding starts. Font and BatchLoader don't collect statistics.
+		 **************************************************************************************************************/
+		DecodeStats* stats{nullptr};
+
+		/**************************************************************************************************************
+		 * Sink receiving the decoding stages, or nullptr to not trace them. Font doesn't trace its decoding.
+		 *
+		 * If decoding is done on several threads or by BatchLoader, the sink must be thread-safe.
+		 **************************************************************************************************************/
+		TraceSink* trace{nullptr};
 	};
 
 	/******************************************************************************************************************
-	 * Encodes a tref file and writes it to a stream.
+	 * Decodes a tref file from a data span.
 	 *
-	 * @exception EncodingError If encoding the data fails.
+	 * @exception DecodingError If decoding the data fails.
+	 * @exception LimitError If decoding the data would exceed one of the limits set in the options.
 	 *
-	 * @param[out] os The output data stream.
+	 * @param[in] data The input data.
+	 * @param[in] options The decoding options.
+	 *
+	 * @return The font information.
+	 ******************************************************************************************************************/
+	DecodingResult decode(std::span<const std::byte> data, const DecodeOptions& options = {});
+
+	/******************************************************************************************************************
+	 * Decodes a tref file from a data span asynchronously.
+	 *
+	 * Decoding is run on DecodeOptions::executor if set, or on a thread pool shared by the library otherwise, which has
+	 * one thread per hardware thread. Decoding errors and cancellation through DecodeOptions::stopToken are reported
+	 * through the future.
+	 *
+	 * @param[in] data The input data. It must stay alive until the future is ready.
+	 * @param[in] options The decoding options.
+	 *
+	 * @return A future holding the font information.
+	 ******************************************************************************************************************/
+	std::future<DecodingResult> decodeAsync(std::span<const std::byte> data, DecodeOptions options = {});
+
+	/******************************************************************************************************************
+	 * Awaitable decoding a tref file asynchronously in a coroutine.
+	 *
+	 * The awaiting coroutine is suspended while the file is decoded as by decodeAsync(), then resumed on the thread
+	 * that decoded it.
+	 ******************************************************************************************************************/
+	class DecodeAwaitable {
+	  public:
+		/**************************************************************************************************************
+		 * Creates an awaitable.
+		 *
+		 * @param[in] data The input data. It must stay alive until the awaiting coroutine is resumed.
+		 * @param[in] options The decoding options.
+		 **************************************************************************************************************/
+		DecodeAwaitable(std::span<const std::byte> data, DecodeOptions options) noexcept;
+
+		/**************************************************************************************************************
+		 * Gets whether the result is already available, which is never the case.
+		 *
+		 * @return false.
+		 **************************************************************************************************************/
+		bool await_ready() const noexcept;
+
+		/**************************************************************************************************************
+		 * Starts decoding, resuming the awaiting coroutine once done.
+		 *
+		 * @param[in] handle The handle of the awaiting coroutine.
+		 **************************************************************************************************************/
+		void await_suspend(std::coroutine_handle<> handle);
+
+		/**************************************************************************************************************
+		 * Gets the decoding result.
+		 *
+		 * @exception DecodingError If decoding the data failed.
+		 * @exception CancellationError If decoding was cancelled.
+		 *
+		 * @return The font information.
+		 **************************************************************************************************************/
+		DecodingResult await_resume();
+
+	  private:
+		std::span<const std::byte>    _data;
+		DecodeOptions                 _options;
+		std::optional<DecodingResult> _result;
+		std::exception_ptr            _error;
+	};
+
+	/******************************************************************************************************************
+	 * Decodes a tref file from a data span in a coroutine.
+	 *
+	 * @code
+	 * const tref::DecodingResult font{co_await tref::awaitDecode(data, options)};
+	 * @endcode
+	 *
+	 * @param[in] data The input data. It must stay alive until the awaiting coroutine is resumed.
+	 * @param[in] options The decoding options.
+	 *
+	 * @return An awaitable returning the font information.
+	 ******************************************************************************************************************/
+	DecodeAwaitable awaitDecode(std::span<const std::byte> data, DecodeOptions options = {});
+
+	/******************************************************************************************************************
+	 * tref file decoding result when the bitmap is written to a caller-provided buffer.
+	 ******************************************************************************************************************/
+	struct DecodingInfo {
+		/**************************************************************************************************************
+		 * The distance between lines in pixels.
+		 **************************************************************************************************************/
+		std::int32_t lineSkip;
+
+		/**************************************************************************************************************
+		 * The font glyph data.
+		 **************************************************************************************************************/
+		GlyphMap glyphs;
+
+		/**************************************************************************************************************
+		 * The size of the decoded bitmap.
+		 **************************************************************************************************************/
+		unsigned int width, height;
+	};
+
+	/******************************************************************************************************************
+	 * Callback used to obtain the buffer the bitmap is decoded into.
+	 *
+	 * The callback is passed the width and height of the bitmap, and must return a span of at least
+	 * width * height * bytesPerPixel(format) bytes, where format is the output format of the decoding options.
+	 ******************************************************************************************************************/
+	using BitmapTarget = std::function<std::span<std::byte>(unsigned int width, unsigned int height)>;
+
+	/******************************************************************************************************************
+	 * Decodes a tref file from a data span, writing the bitmap into a caller-provided buffer.
+	 *
+	 * The input data is only borrowed, and the decompressed payload is stored in @em scratch, which can be reused
+	 * between calls to avoid reallocating it for every decoded file.
+	 *
+	 * @exception DecodingError If decoding the data fails or the target buffer is too small.
+	 *
+	 * @param[in] data The input data.
+	 * @param[in,out] scratch A scratch buffer used for the decompressed payload.
+	 * @param[in] target Callback returning the buffer to decode the bitmap into.
+	 * @param[in] options The decoding options.
+	 *
+	 * @return The font information.
+	 ******************************************************************************************************************/
+	DecodingInfo decode(std::span<const std::byte> data, std::vector<std::byte>& scratch, const BitmapTarget& target,
+						const DecodeOptions& options = {});
+
+	/******************************************************************************************************************
+	 * Batch of decoded bitmap rows.
+	 ******************************************************************************************************************/
+	struct RowBatch {
+		/**************************************************************************************************************
+		 * The size of the whole bitmap.
+		 **************************************************************************************************************/
+		unsigned int width, height;
+
+		/**************************************************************************************************************
+		 * The index of the first row in the batch.
+		 **************************************************************************************************************/
+		unsigned int row;
+
+		/**************************************************************************************************************
+		 * The pixels of the rows in the batch, encoded in the output format of the decoding options.
+		 **************************************************************************************************************/
+		std::span<const std::byte> pixels;
+	};
+
+	/******************************************************************************************************************
+	 * Callback receiving batches of decoded bitmap rows in top-to-bottom order.
+	 *
+	 * The pixel data is only valid for the duration of the call.
+	 ******************************************************************************************************************/
+	using RowSink = std::function<void(const RowBatch& batch)>;
+
+	/******************************************************************************************************************
+	 * The default number of rows passed to a row sink at once.
+	 ******************************************************************************************************************/
+	inline constexpr unsigned int DEFAULT_BATCH_ROWS{16};
+
+	/******************************************************************************************************************
+	 * Decodes a tref file from a data span, passing the bitmap to a sink in batches of rows.
+	 *
+	 * The full bitmap is never allocated; only a buffer for one batch of rows is.
+	 *
+	 * @exception DecodingError If decoding the data fails.
+	 *
+	 * @param[in] data The input data.
+	 * @param[in,out] scratch A scratch buffer used for the decompressed payload.
+	 * @param[in] sink Callback receiving the decoded rows.
+	 * @param[in] batchRows The maximum number of rows passed to the sink at once.
+	 * @param[in] options The decoding options.
+	 *
+	 * @return The font information.
+	 ******************************************************************************************************************/
+	DecodingInfo decode(std::span<const std::byte> data, std::vector<std::byte>& scratch, const RowSink& sink,
+						unsigned int batchRows = DEFAULT_BATCH_ROWS, const DecodeOptions& options = {});
+
+	/******************************************************************************************************************
+	 * Decodes a tref file from a data span into an existing decoding result, reusing its memory.
+	 *
+	 * This is meant for fonts that are reloaded repeatedly, for example when they're edited while an application is
+	 * running. The nodes of the result's glyph map are reused for the new glyphs, so they're only allocated or freed
+	 * if the number of glyphs changes, and its buckets and memory resource are kept. The result's bitmap keeps its data
+	 * if it's large enough, and is given new data allocated as set in the decoding options otherwise. As with the other
+	 * overloads, the decompressed payload is stored in @em scratch.
+	 *
+	 * Once the result and scratch buffer are large enough, reloading a version 1 or 2 file with the same number of
+	 * glyphs into PixelFormat::RGBA8 doesn't allocate any memory. Cropping, other output formats, tiled files and
+	 * pipelining also need scratch buffers that are allocated from DecodeOptions::memoryResource for every call.
+	 *
+	 * @exception DecodingError If decoding the data fails, in which case the contents of the result are unspecified.
+	 *
+	 * @param[in] data The input data.
+	 * @param[in,out] result The decoding result to decode into.
+	 * @param[in,out] scratch A scratch buffer used for the decompressed payload.
+	 * @param[in] options The decoding options.
+	 ******************************************************************************************************************/
+	void decodeInto(std::span<const std::byte> data, DecodingResult& result, std::vector<std::byte>& scratch,
+					const DecodeOptions& options = {});
+
+	/******************************************************************************************************************
+	 * Decoder that reads a tref file from a stream in fixed-size chunks.
+	 *
+	 * The payload is decompressed and decoded as it arrives, so apart from the output bitmap only a small window of
+	 * decompressed data and one input chunk are kept in memory.
+	 ******************************************************************************************************************/
+	class StreamDecoder {
+	  public:
+		/**************************************************************************************************************
+		 * Callback used to read data from the source.
+		 *
+		 * The callback is passed a buffer to read into, and must return the number of bytes read, or 0 if the end of
+		 * the source was reached.
+		 **************************************************************************************************************/
+		using ReadCallback = std::function<std::size_t(std::span<std::byte> buffer)>;
+
+		/**************************************************************************************************************
+		 * The default size of the chunks read from the source.
+		 **************************************************************************************************************/
+		static constexpr std::size_t DEFAULT_CHUNK_SIZE{64 * 1024};
+
+		/**************************************************************************************************************
+		 * Creates a decoder reading from a stream.
+		 *
+		 * @param[in] is The input stream. It must outlive the decoder.
+		 * @param[in] chunkSize The size of the chunks read from the stream.
+		 **************************************************************************************************************/
+		explicit StreamDecoder(std::istream& is, std::size_t chunkSize = DEFAULT_CHUNK_SIZE);
+
+		/**************************************************************************************************************
+		 * Creates a decoder reading from a callback.
+		 *
+		 * @param[in] read The read callback.
+		 * @param[in] chunkSize The size of the chunks read from the callback.
+		 **************************************************************************************************************/
+		explicit StreamDecoder(ReadCallback read, std::size_t chunkSize = DEFAULT_CHUNK_SIZE);
+
+		/**************************************************************************************************************
+		 * Decodes a tref file from the source.
+		 *
+		 * @exception DecodingError If decoding the data fails.
+		 *
+		 * @param[in] options The decoding options.
+		 *
+		 * @return The font information.
+		 **************************************************************************************************************/
+		DecodingResult decode(const DecodeOptions& options = {});
+
+		/**************************************************************************************************************
+		 * Decodes a tref file from the source, writing the bitmap into a caller-provided buffer.
+		 *
+		 * @exception DecodingError If decoding the data fails or the target buffer is too small.
+		 *
+		 * @param[in] target Callback returning the buffer to decode the bitmap into.
+		 * @param[in] options The decoding options.
+		 *
+		 * @return The font information.
+		 **************************************************************************************************************/
+		DecodingInfo decode(const BitmapTarget& target, const DecodeOptions& options = {});
+
+		/**************************************************************************************************************
+		 * Decodes a tref file from the source, passing the bitmap to a sink in batches of rows.
+		 *
+		 * @exception DecodingError If decoding the data fails.
+		 *
+		 * @param[in] sink Callback receiving the decoded rows.
+		 * @param[in] batchRows The maximum number of rows passed to the sink at once.
+		 * @param[in] options The decoding options.
+		 *
+		 * @return The font information.
+		 **************************************************************************************************************/
+		DecodingInfo decode(const RowSink& sink, unsigned int batchRows = DEFAULT_BATCH_ROWS,
+							const DecodeOptions& options = {});
+
+	  private:
+		ReadCallback _read;
+		std::size_t  _chunkSize;
+	};
+
+	/******************************************************************************************************************
+	 * Limits on the work done by a single step of an IncrementalDecoder.
+	 *
+	 * A step stops once any of the limits is reached. Limits of 0 are treated as 1, so that every step makes progress.
+	 ******************************************************************************************************************/
+	struct StepBudget {
+		/**************************************************************************************************************
+		 * The maximum number of compressed bytes to decompress.
+		 *
+		 * The tiles of tiled files (see EncodeOptions) are decompressed whole and aren't counted.
+		 **************************************************************************************************************/
+		std::size_t lz4Bytes{64 * 1024};
+
+		/**************************************************************************************************************
+		 * The maximum number of glyph table entries to read.
+		 **************************************************************************************************************/
+		std::uint32_t glyphs{1024};
+
+		/**************************************************************************************************************
+		 * The maximum number of rows of the stored bitmap to decode, including rows outside of a cropped bitmap.
+		 *
+		 * Tiled files are decoded a row of tiles at a time, so a step decodes at least a whole row of tiles.
+		 **************************************************************************************************************/
+		unsigned int rows{64};
+	};
+
+	/******************************************************************************************************************
+	 * Progress of an IncrementalDecoder.
+	 ******************************************************************************************************************/
+	struct DecodeProgress {
+		/**************************************************************************************************************
+		 * The number of bytes of the input data consumed so far.
+		 **************************************************************************************************************/
+		std::size_t bytesRead;
+
+		/**************************************************************************************************************
+		 * The size of the input data.
+		 **************************************************************************************************************/
+		std::size_t totalBytes;
+
+		/**************************************************************************************************************
+		 * Whether decoding is complete.
+		 **************************************************************************************************************/
+		bool done;
+	};
+
+	/******************************************************************************************************************
+	 * Decoder that decodes a tref file in steps doing a bounded amount of work.
+	 *
+	 * This allows spreading decoding over several frames on a thread that can't block for the whole decoding. The
+	 * thread, executor and pipelining settings of the decoding options are ignored, and the scratch buffers are freed
+	 * as soon as decoding is complete.
+	 ******************************************************************************************************************/
+	class IncrementalDecoder {
+	  public:
+		/**************************************************************************************************************
+		 * Creates a decoder. Nothing is decoded until the first step.
+		 *
+		 * @param[in] data The input data. It must outlive the decoder.
+		 * @param[in] options The decoding options. Ranges and callbacks they refer to must outlive the decoder.
+		 **************************************************************************************************************/
+		explicit IncrementalDecoder(std::span<const std::byte> data, DecodeOptions options = {});
+
+		/**************************************************************************************************************
+		 * Move-constructs a decoder.
+		 *
+		 * @param[in] r The decoder to move from.
+		 **************************************************************************************************************/
+		IncrementalDecoder(IncrementalDecoder&& r) noexcept;
+
+		/**************************************************************************************************************
+		 * Destroys the decoder.
+		 **************************************************************************************************************/
+		~IncrementalDecoder() noexcept;
+
+		/**************************************************************************************************************
+		 * Move-assigns a decoder.
+		 *
+		 * @param[in] r The decoder to move from.
+		 *
+		 * @return A reference to the assigned decoder.
+		 **************************************************************************************************************/
+		IncrementalDecoder& operator=(IncrementalDecoder&& r) noexcept;
+
+		/**************************************************************************************************************
+		 * Continues decoding, doing at most the work allowed by a budget.
+		 *
+		 * Once decoding is complete, steps do nothing. The decoder must not be used anymore after a step threw.
+		 *
+		 * @exception DecodingError If decoding the data fails.
+		 * @exception LimitError If decoding the data would exceed one of the limits set in the options.
+		 * @exception CancellationError If a stop was requested through the decoding options.
+		 *
+		 * @param[in] budget The limits on the work done by the step.
+		 *
+		 * @return The progress of decoding after the step.
+		 **************************************************************************************************************/
+		DecodeProgress step(const StepBudget& budget = {});
+
+		/**************************************************************************************************************
+		 * Finishes decoding without limits if it isn't complete, then takes the result.
+		 *
+		 * May only be called once.
+		 *
+		 * @exception DecodingError If decoding the data fails.
+		 * @exception LimitError If decoding the data would exceed one of the limits set in the options.
+		 * @exception CancellationError If a stop was requested through the decoding options.
+		 *
+		 * @return The font information.
+		 **************************************************************************************************************/
+		DecodingResult result();
+
+	  private:
+		struct Impl;
+
+		std::unique_ptr<Impl> _impl;
+	};
+
+	/******************************************************************************************************************
+	 * tref file metadata obtained without decoding the file.
+	 ******************************************************************************************************************/
+	struct ProbeInfo {
+		/**************************************************************************************************************
+		 * The format version of the file.
+		 **************************************************************************************************************/
+		unsigned int version;
+
+		/**************************************************************************************************************
+		 * The distance between lines in pixels.
+		 **************************************************************************************************************/
+		std::int32_t lineSkip;
+
+		/**************************************************************************************************************
+		 * The number of glyphs in the file.
+		 **************************************************************************************************************/
+		std::uint32_t glyphCount;
+
+		/**************************************************************************************************************
+		 * The size of the stored bitmap.
+		 **************************************************************************************************************/
+		unsigned int width, height;
+
+		/**************************************************************************************************************
+		 * The size of the compressed payload in bytes.
+		 **************************************************************************************************************/
+		std::size_t compressedSize;
+
+		/**************************************************************************************************************
+		 * The size of the decompressed payload in bytes.
+		 **************************************************************************************************************/
+		std::size_t decompressedSize;
+	};
+
+	/******************************************************************************************************************
+	 * Reads the metadata of a tref file without decoding it.
+	 *
+	 * Version 2 files store the metadata in an uncompressed header, so only its 24 bytes are read. For version 1 files,
+	 * the payload is decompressed in small steps until the bitmap header is reached, which only touches the glyph
+	 * table.
+	 *
+	 * @exception DecodingError If the data isn't a valid tref file header.
+	 *
+	 * @param[in] data The input data.
+	 *
+	 * @return The file metadata.
+	 ******************************************************************************************************************/
+	ProbeInfo probe(std::span<const std::byte> data);
+
+	/******************************************************************************************************************
+	 * tref font that decodes its glyph table eagerly and its bitmap lazily.
+	 *
+	 * Only the part of the payload preceding the bitmap is decompressed on construction. The compressed data is kept
+	 * so that the bitmap can be decoded on first access, and decoded again after releasePixels().
+	 ******************************************************************************************************************/
+	class Font {
+	  public:
+		/**************************************************************************************************************
+		 * Creates a font from the data of a tref file, decoding its glyph table.
+		 *
+		 * The codepoint selection and cropping settings of @em options are applied immediately, while the output
+		 * format and memory resource are also used when the bitmap is decoded.
+		 *
+		 * @exception DecodingError If decoding the glyph table fails.
+		 *
+		 * @param[in] data The input data. The font takes ownership of it.
+		 * @param[in] options The decoding options.
+		 **************************************************************************************************************/
+		explicit Font(std::vector<std::byte> data, const DecodeOptions& options = {});
+
+		/**************************************************************************************************************
+		 * Move-constructs a font.
+		 *
+		 * @param[in] r The font to move from. It must not be accessed concurrently.
+		 **************************************************************************************************************/
+		Font(Font&& r) noexcept;
+
+		/**************************************************************************************************************
+		 * Destroys the font.
+		 **************************************************************************************************************/
+		~Font() noexcept;
+
+		/**************************************************************************************************************
+		 * Move-assigns a font.
+		 *
+		 * @param[in] r The font to move from. It must not be accessed concurrently.
+		 *
+		 * @return A reference to the assigned font.
+		 **************************************************************************************************************/
+		Font& operator=(Font&& r) noexcept;
+
+		/**************************************************************************************************************
+		 * Gets the distance between lines.
+		 *
+		 * @return The distance between lines in pixels.
+		 **************************************************************************************************************/
+		std::int32_t lineSkip() const noexcept;
+
+		/**************************************************************************************************************
+		 * Gets the font glyph data.
+		 *
+		 * @return The font glyph data.
+		 **************************************************************************************************************/
+		const GlyphMap& glyphs() const noexcept;
+
+		/**************************************************************************************************************
+		 * Gets the size of the bitmap without decoding it.
+		 *
+		 * @return The size the bitmap has once decoded.
+		 **************************************************************************************************************/
+		unsigned int width() const noexcept;
+
+		/**************************************************************************************************************
+		 * Gets the size of the bitmap without decoding it.
+		 *
+		 * @return The size the bitmap has once decoded.
+		 **************************************************************************************************************/
+		unsigned int height() const noexcept;
+
+		/**************************************************************************************************************
+		 * Gets the font bitmap, decoding it if it isn't already.
+		 *
+		 * Safe to call from multiple threads at once: the bitmap is only decoded once.
+		 *
+		 * @exception DecodingError If decoding the bitmap fails.
+		 *
+		 * @return The font bitmap data. The reference is invalidated by releasePixels().
+		 **************************************************************************************************************/
+		const DecodedBitmap& bitmap() const;
+
+		/**************************************************************************************************************
+		 * Decodes the pixels of a single glyph.
+		 *
+		 * For tiled files (see EncodeOptions), only the tiles overlapping the glyph's texture box are decoded and the
+		 * full bitmap is never decoded. Otherwise, the pixels are copied out of bitmap(), decoding it if needed.
+		 * Safe to call from multiple threads at once, and concurrently with releasePixels().
+		 *
+		 * @exception std::out_of_range If the font has no glyph for the codepoint.
+		 * @exception DecodingError If decoding the pixels fails.
+		 *
+		 * @param[in] cp The codepoint of the glyph.
+		 *
+		 * @return The pixels inside the glyph's texture box, in the output format of the font.
+		 **************************************************************************************************************/
+		DecodedBitmap glyphPixels(Codepoint cp) const;
+
+		/**************************************************************************************************************
+		 * Gets whether the bitmap is currently decoded.
+		 *
+		 * @return Whether the bitmap is currently decoded.
+		 **************************************************************************************************************/
+		bool hasPixels() const noexcept;
+
+		/**************************************************************************************************************
+		 * Frees the decoded bitmap. It will be decoded again on the next call to bitmap().
+		 **************************************************************************************************************/
+		void releasePixels() noexcept;
+
+	  private:
+		struct Tiles;
+
+		std::vector<std::byte>                 _data;
+		std::int32_t                           _lineSkip;
+		GlyphMap                               _glyphs;
+		PixelFormat                            _format;
+		unsigned int                           _storedWidth;
+		unsigned int                           _storedHeight;
+		Rect                                   _region;
+		std::size_t                            _bitmapOffset;
+		mutable std::mutex                     _mutex;
+		std::pmr::memory_resource*             _resource;
+		std::unique_ptr<Tiles>                 _tiles;
+		mutable std::unique_ptr<DecodedBitmap> _bitmap;
+
+		// Gets the font bitmap, decoding it if it isn't already. _mutex must be held by the caller.
+		const DecodedBitmap& decodeBitmap() const;
+	};
+
+	///
+
+	/******************************************************************************************************************
+	 * Error thrown when opening or mapping a file fails.
+	 ******************************************************************************************************************/
+	struct FileError : std::runtime_error {
+		using runtime_error::runtime_error;
+	};
+
+	/******************************************************************************************************************
+	 * Hint about how a memory-mapped file is going to be accessed.
+	 ******************************************************************************************************************/
+	enum class AccessHint : std::uint8_t {
+		/**************************************************************************************************************
+		 * No hint is given to the operating system.
+		 **************************************************************************************************************/
+		NORMAL,
+
+		/**************************************************************************************************************
+		 * The file will be read sequentially (MADV_SEQUENTIAL).
+		 **************************************************************************************************************/
+		SEQUENTIAL,
+
+		/**************************************************************************************************************
+		 * The whole file will be needed soon and should be prefetched (MADV_WILLNEED).
+		 **************************************************************************************************************/
+		WILL_NEED
+	};
+
+	/******************************************************************************************************************
+	 * Read-only memory mapping of a file.
+	 ******************************************************************************************************************/
+	class MappedFile {
+	  public:
+		/**************************************************************************************************************
+		 * Maps a file into memory.
+		 *
+		 * @exception FileError If opening or mapping the file fails.
+		 *
+		 * @param[in] path The path to the file.
+		 * @param[in] hint A hint about how the mapping is going to be accessed.
+		 **************************************************************************************************************/
+		explicit MappedFile(const std::filesystem::path& path, AccessHint hint = AccessHint::SEQUENTIAL);
+
+		/**************************************************************************************************************
+		 * Move-constructs a mapping.
+		 *
+		 * @param[in] r The mapping to move from. It is left empty.
+		 **************************************************************************************************************/
+		MappedFile(MappedFile&& r) noexcept;
+
+		/**************************************************************************************************************
+		 * Unmaps the file.
+		 **************************************************************************************************************/
+		~MappedFile() noexcept;
+
+		/**************************************************************************************************************
+		 * Move-assigns a mapping.
+		 *
+		 * @param[in] r The mapping to move from. It is left empty.
+		 *
+		 * @return A reference to the assigned mapping.
+		 **************************************************************************************************************/
+		MappedFile& operator=(MappedFile&& r) noexcept;
+
+		/**************************************************************************************************************
+		 * Gets the mapped data.
+		 *
+		 * @return A span over the contents of the file.
+		 **************************************************************************************************************/
+		std::span<const std::byte> data() const noexcept;
+
+	  private:
+		const std::byte* _data;
+		std::size_t      _size;
+	};
+
+	/******************************************************************************************************************
+	 * Loads and decodes a tref file by mapping it into memory.
+	 *
+	 * @exception FileError If opening or mapping the file fails.
+	 * @exception DecodingError If decoding the data fails.
+	 *
+	 * @param[in] path The path to the file.
+	 * @param[in] hint A hint about how the mapping is going to be accessed.
+	 * @param[in] options The decoding options.
+	 *
+	 * @return The font information.
+	 ******************************************************************************************************************/
+	DecodingResult loadFile(const std::filesystem::path& path, AccessHint hint = AccessHint::SEQUENTIAL,
+							const DecodeOptions& options = {});
+
+	/******************************************************************************************************************
+	 * Reads the metadata of a tref file without decoding it.
+	 *
+	 * The file is mapped into memory, so only the pages containing the metadata are actually read.
+	 *
+	 * @exception FileError If opening or mapping the file fails.
+	 * @exception DecodingError If the file doesn't have a valid tref file header.
+	 *
+	 * @param[in] path The path to the file.
+	 *
+	 * @return The file metadata.
+	 ******************************************************************************************************************/
+	ProbeInfo probeFile(const std::filesystem::path& path);
+
+	/******************************************************************************************************************
+	 * Loader of many tref files at once that overlaps reading files with decoding them.
+	 *
+	 * On Linux, reads are submitted all at once through io_uring. If io_uring is unavailable, or on other platforms,
+	 * files are read by a pool of threads instead. Each file is decoded on a pool of worker threads as soon as it was
+	 * read.
+	 ******************************************************************************************************************/
+	class BatchLoader {
+	  public:
+		/**************************************************************************************************************
+		 * Default maximum number of reads in flight.
+		 **************************************************************************************************************/
+		static constexpr unsigned int DEFAULT_QUEUE_DEPTH{64};
+
+		/**************************************************************************************************************
+		 * Result of loading a single file.
+		 **************************************************************************************************************/
+		struct Result {
+			/**********************************************************************************************************
+			 * The index of the file in the list of paths passed to load().
+			 **********************************************************************************************************/
+			std::size_t index;
+
+			/**********************************************************************************************************
+			 * The font information, if loading the file succeeded.
+			 **********************************************************************************************************/
+			std::optional<DecodingResult> font;
+
+			/**********************************************************************************************************
+			 * The exception thrown while loading the file (FileError, DecodingError, ...), if it failed.
+			 **********************************************************************************************************/
+			std::exception_ptr error;
+		};
+
+		/**************************************************************************************************************
+		 * Creates a loader.
+		 *
+		 * @param[in] threads The number of worker threads, or 0 to use one per hardware thread.
+		 * @param[in] queueDepth The maximum number of reads in flight.
+		 **************************************************************************************************************/
+		explicit BatchLoader(unsigned int threads = 0, unsigned int queueDepth = DEFAULT_QUEUE_DEPTH);
+
+		/**************************************************************************************************************
+		 * Stops the worker threads.
+		 **************************************************************************************************************/
+		~BatchLoader() noexcept;
+
+		/**************************************************************************************************************
+		 * Gets whether reads are done through io_uring.
+		 *
+		 * @return Whether reads are done through io_uring.
+		 **************************************************************************************************************/
+		bool usesIoUring() const noexcept;
+
+		/**************************************************************************************************************
+		 * Loads and decodes a list of tref files.
+		 *
+		 * Errors are reported per file rather than thrown. Only one call may be running at a time.
+		 *
+		 * @param[in] paths The paths to the files.
+		 * @param[in] options The decoding options.
+		 *
+		 * @return The result for every file, in the order loading the files completed.
+		 **************************************************************************************************************/
+		std::vector<Result> load(std::span<const std::filesystem::path> paths, const DecodeOptions& options = {});
+
+	  private:
+		struct Impl;
+
+		std::unique_ptr<Impl> _impl;
+	};
+
+	///
+
+	/******************************************************************************************************************
+	 * Struct containing data about the bitmap to encode into a tref file.
+	 ******************************************************************************************************************/
+	struct BitmapRef {
+		/**************************************************************************************************************
+		 * Pointer to the beginning of the bitmap data.
+		 **************************************************************************************************************/
+		const std::byte* data;
+
+		/**************************************************************************************************************
+		 * The size of the bitmap.
+		 **************************************************************************************************************/
+		unsigned int width, height;
+	};
+
+	/******************************************************************************************************************
+	 * Error thrown when encoding a tref file fails.
+	 ******************************************************************************************************************/
+	struct EncodingError : std::runtime_error {
+		using runtime_error::runtime_error;
+	};
+
+	/******************************************************************************************************************
+	 * Statistics about encoding a tref file, collected through EncodeOptions::stats.
+	 ******************************************************************************************************************/
+	struct EncodeStats {
+		/**************************************************************************************************************
+		 * The size of the written file in bytes.
+		 **************************************************************************************************************/
+		std::size_t fileSize{0};
+
+		/**************************************************************************************************************
+		 * The size of the payload before compression in bytes.
+		 **************************************************************************************************************/
+		std::size_t decompressedSize{0};
+
+		/**************************************************************************************************************
+		 * The size of the input bitmap in bytes.
+		 **************************************************************************************************************/
+		std::size_t bitmapSize{0};
+
+		/**************************************************************************************************************
+		 * The number of glyphs written.
+		 **************************************************************************************************************/
+		std::size_t glyphCount{0};
+
+		/**************************************************************************************************************
+		 * The time spent compressing the payload, or the glyph table and tiles.
+		 **************************************************************************************************************/
+		std::chrono::nanoseconds lz4Time{0};
+
+		/**************************************************************************************************************
+		 * The time spent writing the glyph table.
+		 **************************************************************************************************************/
+		std::chrono::nanoseconds glyphTime{0};
+
+		/**************************************************************************************************************
+		 * The time spent encoding the bitmap to QOI.
+		 **************************************************************************************************************/
+		std::chrono::nanoseconds qoiTime{0};
+	};
+
+	/******************************************************************************************************************
+	 * Compression applied to the data of encoded tref files.
+	 *
+	 * All modes produce data that decodes at the same speed, they only trade encoding time for file size.
+	 ******************************************************************************************************************/
+	enum class Compression : std::uint8_t {
+		/**************************************************************************************************************
+		 * LZ4's default compression.
+		 **************************************************************************************************************/
+		DEFAULT,
+
+		/**************************************************************************************************************
+		 * LZ4's accelerated compression, faster but with a worse ratio the higher EncodeOptions::level is.
+		 **************************************************************************************************************/
+		FAST,
+
+		/**************************************************************************************************************
+		 * LZ4 HC, slower but with a better ratio the higher EncodeOptions::level is.
+		 **************************************************************************************************************/
+		HIGH
+	};
+
+	/******************************************************************************************************************
+	 * Options controlling how a tref file is encoded.
+	 ******************************************************************************************************************/
+	struct EncodeOptions {
+		/**************************************************************************************************************
+		 * The size of the independently compressed tiles the bitmap is split into.
+		 *
+		 * If both are 0, the bitmap is stored as a single image. Otherwise, the bitmap is split into tiles that can be
+		 * decoded on their own (see Font::glyphPixels()) and in parallel (see DecodeOptions::threads), with a size of 0
+		 * standing for the full bitmap dimension.
+		 **************************************************************************************************************/
+		unsigned int tileWidth{0}, tileHeight{0};
+
+		/**************************************************************************************************************
+		 * The compression applied to the glyph table and bitmap.
+		 **************************************************************************************************************/
+		Compression compression{Compression::DEFAULT};
+
+		/**************************************************************************************************************
+		 * The compression level, ignored by Compression::DEFAULT.
+		 *
+		 * With Compression::FAST, this is the acceleration factor, from 1 (equivalent to the default compression) to
+		 * 65537. With Compression::HIGH, this is the LZ4 HC level from 1 to 12, with 0 standing for LZ4 HC's default
+		 * of 9. Other values are clamped to these ranges, so that for example a negative level is level 1 with either
+		 * compression.
+		 **************************************************************************************************************/
+		int level{0};
+
+		/**************************************************************************************************************
+		 * Statistics filled in by encoding, or nullptr to not collect any.
+		 **************************************************************************************************************/
+		EncodeStats* stats{nullptr};
+
+		/**************************************************************************************************************
+		 * Sink receiving the encoding stages, or nullptr to not trace them.
+		 **************************************************************************************************************/
+		TraceSink* trace{nullptr};
+	};
+
+	/******************************************************************************************************************
+	 * Encodes a tref file and writes it to a stream.
+	 *
+	 * Files are written in format version 2, which stores the font metadata in an uncompressed header readable with
+	 * probe(), or in format version 3 if the bitmap is tiled. Glyphs are written sorted by codepoint, so encoding the
+	 * same font with the same options always produces the same bytes, regardless of how the glyph map was built. Like
+	 * with the callback overload, the file is built in memory before being written.
+	 *
+	 * @exception EncodingError If encoding the data fails.
+	 *
+	 * @param[out] os The output data stream.
+	 * @param[in] lineSkip The distance between lines in pixels.
+	 * @param[in] glyphs The font glyph data.
+	 * @param[in] bitmap The font bitmap data.
+	 * @param[in] options The encoding options.
+	 ******************************************************************************************************************/
+	void encode(std::ostream& os, std::int32_t lineSkip, const GlyphMap& glyphs, const BitmapRef& bitmap,
+				const EncodeOptions& options = {});
+
+	/******************************************************************************************************************
+	 * Encodes a tref file into a buffer.
+	 *
+	 * The buffer's contents are replaced by the file, which is compressed straight into it, so the buffer can be
+	 * reused between calls to avoid reallocating it for every encoded file.
+	 *
+	 * @exception EncodingError If encoding the data fails.
+	 *
+	 * @param[out] buffer The buffer receiving the file data.
+	 * @param[in] lineSkip The distance between lines in pixels.
+	 * @param[in] glyphs The font glyph data.
+	 * @param[in] bitmap The font bitmap data.
+	 * @param[in] options The encoding options.
+	 ******************************************************************************************************************/
+	void encodeToBuffer(std::vector<std::byte>& buffer, std::int32_t lineSkip, const GlyphMap& glyphs,
+						const BitmapRef& bitmap, const EncodeOptions& options = {});
+
+	/******************************************************************************************************************
+	 * Callback receiving the data of an encoded tref file.
+	 ******************************************************************************************************************/
+	using WriteCallback = std::function<void(std::span<const std::byte> data)>;
+
+	/******************************************************************************************************************
+	 * Encodes a tref file and passes it to a callback.
+	 *
+	 * The file is built in memory and passed to the callback in a single call, as the header and tile table depend on
+	 * the compressed data, and untiled bitmaps are compressed as a single LZ4 block. encodeToBuffer() can reuse that
+	 * memory between files.
+	 *
+	 * @exception EncodingError If encoding the data fails.
+	 *
+	 * @param[in] write Callback receiving the file data.
 	 * @param[in] lineSkip The distance between lines in pixels.
 	 * @param[in] glyphs The font glyph data.
 	 * @param[in] bitmap The font bitmap data.
+	 * @param[in] options The encoding options.
 	 ******************************************************************************************************************/
-	void encode(std::ostream& os, std::int32_t lineSkip, const GlyphMap& glyphs, const BitmapRef& bitmap);
+	void encode(const WriteCallback& write, std::int32_t lineSkip, const GlyphMap& glyphs, const BitmapRef& bitmap,
+				const EncodeOptions& options = {});
 
 	/// @}
 } // namespace tref
\ No newline at end of file
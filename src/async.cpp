@@ -0,0 +1,73 @@
+#include "common.hpp"
+
+namespace tref::detail {
+	// Runs a task on an executor, or on the shared pool if there is none.
+	void schedule(tref::Executor* executor, std::function<void()> task)
+	{
+		if (executor != nullptr) {
+			executor->execute(std::move(task));
+		}
+		else {
+			sharedPool().post(std::move(task));
+		}
+	}
+
+	void checkStop(const tref::DecodeOptions& options)
+	{
+		if (options.stopToken.stop_requested()) {
+			throw tref::CancellationError{"Decoding of .tref file was cancelled."};
+		}
+	}
+} // namespace tref::detail
+
+std::future<tref::DecodingResult> tref::decodeAsync(std::span<const std::byte> data, DecodeOptions options)
+{
+	const auto                  promise{std::make_shared<std::promise<DecodingResult>>()};
+	std::future<DecodingResult> future{promise->get_future()};
+	Executor* const             executor{options.executor};
+	detail::schedule(executor, [promise, data, options = std::move(options)] {
+		try {
+			promise->set_value(decode(data, options));
+		}
+		catch (...) {
+			promise->set_exception(std::current_exception());
+		}
+	});
+	return future;
+}
+
+tref::DecodeAwaitable::DecodeAwaitable(std::span<const std::byte> data, DecodeOptions options) noexcept
+	: _data{data}, _options{std::move(options)}
+{
+}
+
+bool tref::DecodeAwaitable::await_ready() const noexcept
+{
+	return false;
+}
+
+void tref::DecodeAwaitable::await_suspend(std::coroutine_handle<> handle)
+{
+	detail::schedule(_options.executor, [this, handle] {
+		try {
+			_result.emplace(decode(_data, _options));
+		}
+		catch (...) {
+			_error = std::current_exception();
+		}
+		handle.resume();
+	});
+}
+
+tref::DecodingResult tref::DecodeAwaitable::await_resume()
+{
+	if (_error != nullptr) {
+		std::rethrow_exception(_error);
+	}
+	return std::move(*_result);
+}
+
+tref::DecodeAwaitable tref::awaitDecode(std::span<const std::byte> data, DecodeOptions options)
+{
+	return DecodeAwaitable{data, std::move(options)};
+}
\ No newline at end of file
@@ -0,0 +1,491 @@
+#include "common.hpp"
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#ifdef __linux__
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <system_error>
+#include <unistd.h>
+#endif
+
+namespace tref::detail {
+	// Collector of the results of a call to BatchLoader::load().
+	class ResultQueue {
+	  public:
+		explicit ResultQueue(std::size_t expected)
+			: _expected{expected}
+		{
+			_results.reserve(expected);
+		}
+
+		void push(tref::BatchLoader::Result&& result)
+		{
+			std::lock_guard lock{_mutex};
+			_results.push_back(std::move(result));
+			if (_results.size() == _expected) {
+				_done.notify_all();
+			}
+		}
+
+		// Runs a function producing the font of a file and pushes its result.
+		template <class Fn> void complete(std::size_t index, Fn&& fn)
+		{
+			tref::BatchLoader::Result result{index, std::nullopt, nullptr};
+			try {
+				result.font.emplace(fn());
+			}
+			catch (...) {
+				result.error = std::current_exception();
+			}
+			push(std::move(result));
+		}
+
+		std::vector<tref::BatchLoader::Result> wait()
+		{
+			std::unique_lock lock{_mutex};
+			_done.wait(lock, [this] { return _results.size() == _expected; });
+			return std::move(_results);
+		}
+
+	  private:
+		std::size_t                            _expected;
+		std::mutex                             _mutex;
+		std::condition_variable                _done;
+		std::vector<tref::BatchLoader::Result> _results;
+	};
+
+#ifdef __linux__
+	// Minimal io_uring submitting reads, driven through the raw system calls to avoid depending on liburing.
+	// Only the thread calling BatchLoader::load() touches the ring, so the kernel is the only other party.
+	class IoUring {
+	  public:
+		// Creates a ring, or returns nullptr if io_uring or its read operation isn't available.
+		static std::unique_ptr<IoUring> create(unsigned int entries)
+		{
+			io_uring_params params{};
+			const int       fd{static_cast<int>(syscall(__NR_io_uring_setup, entries, &params))};
+			if (fd < 0) {
+				return nullptr;
+			}
+			std::unique_ptr<IoUring> ring{new IoUring{fd, params}};
+			if (!ring->map(params) || !ring->supportsRead()) {
+				return nullptr;
+			}
+			return ring;
+		}
+
+		IoUring(const IoUring&) = delete;
+
+		~IoUring() noexcept
+		{
+			if (_sqes != MAP_FAILED) {
+				munmap(_sqes, _sqesSize);
+			}
+			if (_cqRing != MAP_FAILED && _cqRing != _sqRing) {
+				munmap(_cqRing, _cqRingSize);
+			}
+			if (_sqRing != MAP_FAILED) {
+				munmap(_sqRing, _sqRingSize);
+			}
+			close(_fd);
+		}
+
+		// Gets the maximum number of operations that can be queued before submitting them.
+		unsigned int capacity() const noexcept
+		{
+			return _sqEntries;
+		}
+
+		// Queues a read; at most capacity() reads may be queued between calls to submitAndWait().
+		void queueRead(int fd, std::byte* buffer, std::size_t size, std::uint64_t offset,
+					   std::uint64_t userData) noexcept
+		{
+			const std::uint32_t tail{*_sqTail};
+			const std::uint32_t index{tail & _sqMask};
+			io_uring_sqe&       sqe{_sqes[index]};
+			std::memset(&sqe, 0, sizeof(sqe));
+			sqe.opcode    = IORING_OP_READ;
+			sqe.fd        = fd;
+			sqe.addr      = reinterpret_cast<std::uint64_t>(buffer);
+			sqe.len       = static_cast<std::uint32_t>(std::min<std::size_t>(size, MAX_READ_SIZE));
+			sqe.off       = offset;
+			sqe.user_data = userData;
+			_sqArray[index] = index;
+			std::atomic_ref{*_sqTail}.store(tail + 1, std::memory_order_release);
+			++_queued;
+		}
+
+		// Submits the queued operations and waits for at least one completion.
+		void submitAndWait()
+		{
+			while (true) {
+				const long submitted{syscall(__NR_io_uring_enter, _fd, _queued, 1, IORING_ENTER_GETEVENTS, nullptr, 0)};
+				if (submitted >= 0) {
+					_queued -= static_cast<unsigned int>(submitted);
+					if (_queued == 0) {
+						return;
+					}
+				}
+				else if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+					throw std::system_error{errno, std::system_category(), "io_uring_enter"};
+				}
+			}
+		}
+
+		// Takes the next completion, if there is one.
+		bool pop(io_uring_cqe& cqe) noexcept
+		{
+			const std::uint32_t head{*_cqHead};
+			if (head == std::atomic_ref{*_cqTail}.load(std::memory_order_acquire)) {
+				return false;
+			}
+			cqe = _cqes[head & _cqMask];
+			std::atomic_ref{*_cqHead}.store(head + 1, std::memory_order_release);
+			return true;
+		}
+
+	  private:
+		// Reads are split so their size fits in a submission entry.
+		static constexpr std::size_t MAX_READ_SIZE{std::size_t{1} << 30};
+
+		int            _fd;
+		unsigned int   _sqEntries;
+		unsigned int   _queued{0};
+		void*          _sqRing{MAP_FAILED};
+		void*          _cqRing{MAP_FAILED};
+		std::size_t    _sqRingSize;
+		std::size_t    _cqRingSize;
+		std::size_t    _sqesSize;
+		io_uring_sqe*  _sqes{static_cast<io_uring_sqe*>(MAP_FAILED)};
+		std::uint32_t* _sqTail{nullptr};
+		std::uint32_t  _sqMask{0};
+		std::uint32_t* _sqArray{nullptr};
+		std::uint32_t* _cqHead{nullptr};
+		std::uint32_t* _cqTail{nullptr};
+		std::uint32_t  _cqMask{0};
+		io_uring_cqe*  _cqes{nullptr};
+
+		IoUring(int fd, const io_uring_params& params) noexcept
+			: _fd{fd}
+			, _sqEntries{params.sq_entries}
+			, _sqRingSize{params.sq_off.array + params.sq_entries * sizeof(std::uint32_t)}
+			, _cqRingSize{params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe)}
+			, _sqesSize{params.sq_entries * sizeof(io_uring_sqe)}
+		{
+		}
+
+		// Maps the rings and the submission entries.
+		bool map(const io_uring_params& params) noexcept
+		{
+			if (params.features & IORING_FEAT_SINGLE_MMAP) {
+				_sqRingSize = _cqRingSize = std::max(_sqRingSize, _cqRingSize);
+			}
+			_sqRing = mmap(nullptr, _sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd,
+						   IORING_OFF_SQ_RING);
+			if (_sqRing == MAP_FAILED) {
+				return false;
+			}
+			if (params.features & IORING_FEAT_SINGLE_MMAP) {
+				_cqRing = _sqRing;
+			}
+			else {
+				_cqRing = mmap(nullptr, _cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd,
+							   IORING_OFF_CQ_RING);
+				if (_cqRing == MAP_FAILED) {
+					return false;
+				}
+			}
+			void* const sqes{
+				mmap(nullptr, _sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQES)};
+			if (sqes == MAP_FAILED) {
+				return false;
+			}
+			_sqes = static_cast<io_uring_sqe*>(sqes);
+
+			std::byte* const sq{static_cast<std::byte*>(_sqRing)};
+			std::byte* const cq{static_cast<std::byte*>(_cqRing)};
+			_sqTail  = reinterpret_cast<std::uint32_t*>(sq + params.sq_off.tail);
+			_sqMask  = *reinterpret_cast<std::uint32_t*>(sq + params.sq_off.ring_mask);
+			_sqArray = reinterpret_cast<std::uint32_t*>(sq + params.sq_off.array);
+			_cqHead  = reinterpret_cast<std::uint32_t*>(cq + params.cq_off.head);
+			_cqTail  = reinterpret_cast<std::uint32_t*>(cq + params.cq_off.tail);
+			_cqMask  = *reinterpret_cast<std::uint32_t*>(cq + params.cq_off.ring_mask);
+			_cqes    = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+			return true;
+		}
+
+		// Checks that the kernel supports reads through the ring (Linux 5.6 and newer).
+		bool supportsRead() const noexcept
+		{
+			constexpr unsigned int  OPS{IORING_OP_READ + 1};
+			std::vector<std::byte>  storage(sizeof(io_uring_probe) + OPS * sizeof(io_uring_probe_op));
+			io_uring_probe* const   probe{reinterpret_cast<io_uring_probe*>(storage.data())};
+			if (syscall(__NR_io_uring_register, _fd, IORING_REGISTER_PROBE, probe, OPS) < 0) {
+				return false;
+			}
+			return probe->last_op >= IORING_OP_READ && (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED);
+		}
+	};
+
+	// Owner of an open file descriptor.
+	class FileDescriptor {
+	  public:
+		FileDescriptor() noexcept = default;
+
+		explicit FileDescriptor(int fd) noexcept
+			: _fd{fd}
+		{
+		}
+
+		FileDescriptor(FileDescriptor&& r) noexcept
+			: _fd{std::exchange(r._fd, -1)}
+		{
+		}
+
+		FileDescriptor& operator=(FileDescriptor&& r) noexcept
+		{
+			FileDescriptor old{std::move(r)};
+			std::swap(_fd, old._fd);
+			return *this;
+		}
+
+		~FileDescriptor() noexcept
+		{
+			if (_fd != -1) {
+				close(_fd);
+			}
+		}
+
+		int get() const noexcept
+		{
+			return _fd;
+		}
+
+	  private:
+		int _fd{-1};
+	};
+
+	// A file being read through the ring.
+	struct PendingRead {
+		FileDescriptor         fd;
+		std::vector<std::byte> data;
+		std::size_t            done{0};
+		// Whether the file was given a result or handed to the workers.
+		bool                   reported{false};
+	};
+
+	// Reads the files through the ring, handing each one to the workers to decode as soon as it was read.
+	// If reading fails, the reads in flight are waited for and every file not handed to the workers yet is given the
+	// error as its result before it is rethrown. If the ring itself fails, it is released along with the buffers it may
+	// still write into rather than destroyed, and ring is left null.
+	void readWithRing(std::unique_ptr<IoUring>& ring, WorkerPool& workers, ResultQueue& results,
+					  std::span<const std::filesystem::path> paths, const tref::DecodeOptions& options)
+	{
+		// The files are only referenced through files, so they can be leaked by releasing pending.
+		auto                      pending{std::make_unique<std::vector<PendingRead>>(paths.size())};
+		std::vector<PendingRead>& files{*pending};
+		std::size_t               next{0};
+		unsigned int              inFlight{0};
+
+		// Hands a fully read file to the workers.
+		const auto dispatch{[&](std::size_t index) {
+			PendingRead& file{files[index]};
+			file.fd = {};
+			workers.post([&results, &options, index, data = std::move(file.data)] {
+				results.complete(index, [&] { return tref::decode(data, options); });
+			});
+			file.reported = true;
+		}};
+
+		// Reports a file that failed to be read.
+		const auto fail{[&](std::size_t index, std::exception_ptr error) {
+			PendingRead& file{files[index]};
+			file.fd   = {};
+			file.data = {};
+			results.push({index, std::nullopt, std::move(error)});
+			file.reported = true;
+		}};
+		const auto failWith{[&](std::size_t index, const char* message) {
+			fail(index, std::make_exception_ptr(tref::FileError{message}));
+		}};
+
+		// Waits for the reads in flight without continuing them. Returns false if the ring failed.
+		const auto drain{[&]() noexcept {
+			try {
+				while (inFlight > 0) {
+					ring->submitAndWait();
+					io_uring_cqe cqe;
+					while (ring->pop(cqe)) {
+						--inFlight;
+					}
+				}
+				return true;
+			}
+			catch (...) {
+				return false;
+			}
+		}};
+
+		try {
+			while (true) {
+				// Opens files until as many reads as the ring holds are in flight, bounding the number of open files.
+				while (next < paths.size() && inFlight < ring->capacity()) {
+					const std::size_t index{next++};
+					FileDescriptor    fd{open(paths[index].c_str(), O_RDONLY | O_CLOEXEC)};
+					if (fd.get() == -1) {
+						failWith(index, "Failed to open .tref file.");
+						continue;
+					}
+					struct stat info;
+					if (fstat(fd.get(), &info) == -1) {
+						failWith(index, "Failed to get .tref file size.");
+						continue;
+					}
+					PendingRead& file{files[index]};
+					try {
+						file.data.resize(static_cast<std::size_t>(info.st_size));
+					}
+					catch (...) {
+						fail(index, std::current_exception());
+						continue;
+					}
+					if (file.data.empty()) {
+						dispatch(index);
+						continue;
+					}
+					file.fd = std::move(fd);
+					ring->queueRead(file.fd.get(), file.data.data(), file.data.size(), 0, index);
+					++inFlight;
+				}
+				if (inFlight == 0) {
+					return;
+				}
+
+				ring->submitAndWait();
+				io_uring_cqe cqe;
+				while (ring->pop(cqe)) {
+					--inFlight;
+					const std::size_t index{static_cast<std::size_t>(cqe.user_data)};
+					PendingRead&      file{files[index]};
+					if (cqe.res <= 0) {
+						failWith(index, cqe.res < 0 ? "Failed to read .tref file." : "Unexpected end of .tref file.");
+					}
+					else if ((file.done += static_cast<std::size_t>(cqe.res)) < file.data.size()) {
+						// Short reads are continued where they stopped.
+						ring->queueRead(file.fd.get(), file.data.data() + file.done, file.data.size() - file.done,
+										file.done, index);
+						++inFlight;
+					}
+					else {
+						dispatch(index);
+					}
+				}
+			}
+		}
+		catch (...) {
+			// The kernel may still write into the buffers of the reads in flight, so they can't be freed before them.
+			if (!drain()) {
+				for (PendingRead& file : files) {
+					file.fd = {};
+				}
+				static_cast<void>(pending.release());
+				static_cast<void>(ring.release());
+			}
+
+			const std::exception_ptr error{std::current_exception()};
+			for (std::size_t i = 0; i < paths.size(); ++i) {
+				if (!files[i].reported) {
+					results.push({i, std::nullopt, error});
+				}
+			}
+			throw;
+		}
+	}
+#endif
+} // namespace tref::detail
+
+struct tref::BatchLoader::Impl {
+#ifdef __linux__
+	std::unique_ptr<detail::IoUring> ring;
+#endif
+	std::mutex         loadMutex;
+	detail::WorkerPool workers;
+
+	Impl(unsigned int threads, unsigned int queueDepth)
+		:
+#ifdef __linux__
+		ring{detail::IoUring::create(std::max(queueDepth, 1U))},
+#endif
+		workers{threads != 0 ? threads : std::max(std::thread::hardware_concurrency(), 1U)}
+	{
+	}
+};
+
+tref::BatchLoader::BatchLoader(unsigned int threads, unsigned int queueDepth)
+	: _impl{std::make_unique<Impl>(threads, queueDepth)}
+{
+}
+
+tref::BatchLoader::~BatchLoader() noexcept = default;
+
+bool tref::BatchLoader::usesIoUring() const noexcept
+{
+#ifdef __linux__
+	return _impl->ring != nullptr;
+#else
+	return false;
+#endif
+}
+
+std::vector<tref::BatchLoader::Result> tref::BatchLoader::load(std::span<const std::filesystem::path> paths,
+															   const DecodeOptions&                   fileOptions)
+{
+	// Files are decoded concurrently, so they can't share the statistics.
+	DecodeOptions options{fileOptions};
+	options.stats = nullptr;
+
+	std::lock_guard     lock{_impl->loadMutex};
+	detail::ResultQueue results{paths.size()};
+#ifdef __linux__
+	if (_impl->ring != nullptr) {
+		try {
+			detail::readWithRing(_impl->ring, _impl->workers, results, paths, options);
+		}
+		catch (...) {
+			// Every file was given a result, so this only waits for the workers to stop using results and options.
+			results.wait();
+			throw;
+		}
+		return results.wait();
+	}
+#endif
+
+	// Without io_uring, the workers both read and decode the files.
+	std::size_t posted{0};
+	try {
+		for (; posted < paths.size(); ++posted) {
+			_impl->workers.post([&results, &options, &path = paths[posted], i = posted] {
+				results.complete(i, [&] { return loadFile(path, AccessHint::SEQUENTIAL, options); });
+			});
+		}
+	}
+	catch (...) {
+		// The files already posted still use results and options, so they're waited for.
+		for (std::size_t i = posted; i < paths.size(); ++i) {
+			results.push({i, std::nullopt, std::current_exception()});
+		}
+		results.wait();
+		throw;
+	}
+	return results.wait();
+}
\ No newline at end of file
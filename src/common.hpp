@@ -0,0 +1,577 @@
+#pragma once
+#include "../include/tref/qoi.h"
+#include "../include/tref/tref.hpp"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace tref::detail {
+	// Size of a serialized glyph table entry.
+	inline constexpr std::size_t GLYPH_ENTRY_SIZE{sizeof(tref::Codepoint) + sizeof(tref::Glyph)};
+
+	// Size of the QOI header preceding the image chunks.
+	inline constexpr std::size_t QOI_HEADER_BYTES{14};
+
+	// Size of the QOI end marker following the image chunks.
+	inline constexpr std::size_t QOI_END_MARKER_BYTES{8};
+
+	// Size of the preamble of a version 1 file: magic and decompressed payload size.
+	inline constexpr std::size_t FILE_HEADER_V1_BYTES{8};
+
+	// Size of the preamble of a version 2 file: magic, font metadata and decompressed payload size.
+	inline constexpr std::size_t FILE_HEADER_V2_BYTES{24};
+
+	// Size of the preamble of a version 3 (tiled) file: version 2 preamble, tile size and glyph table block size.
+	inline constexpr std::size_t FILE_HEADER_V3_BYTES{36};
+
+	// Size of a tile table entry: compressed and decompressed tile size.
+	inline constexpr std::size_t TILE_ENTRY_SIZE{8};
+
+	// Upper bound on the ratio between the decompressed and compressed size of an LZ4 block, used to reject sizes that
+	// can't be right before allocating for them.
+	inline constexpr std::size_t LZ4_MAX_RATIO{255};
+
+	// Names of the stages reported to trace sinks.
+	inline constexpr const char* HEADER_STAGE{"header read"};
+	inline constexpr const char* LZ4_DECOMPRESS_STAGE{"LZ4 decompress"};
+	inline constexpr const char* GLYPH_TABLE_STAGE{"glyph table"};
+	inline constexpr const char* QOI_DECODE_STAGE{"QOI decode"};
+	inline constexpr const char* QOI_ENCODE_STAGE{"QOI encode"};
+	inline constexpr const char* LZ4_COMPRESS_STAGE{"LZ4 compress"};
+
+	// Uncompressed preamble of a tref file.
+	struct FileHeader {
+		unsigned int  version;
+		std::uint32_t rawSize;
+		// The following fields are only stored in the preamble of version 2 and later files.
+		std::int32_t  lineSkip;
+		std::uint32_t glyphCount;
+		std::uint32_t width, height;
+		// The following fields are only stored in the preamble of version 3 files.
+		std::uint32_t tileWidth, tileHeight;
+		std::uint32_t glyphTableSize;
+	};
+
+	// Layout of the independently compressed tiles of a version 3 file.
+	struct TileLayout {
+		unsigned int             width, height;
+		unsigned int             tileWidth, tileHeight;
+		unsigned int             columns, rows;
+		// Total size of the decompressed tiles given by the preamble.
+		std::size_t              rawSize;
+		// Offsets of the compressed tiles relative to the first tile, followed by the end offset of the last tile.
+		std::vector<std::size_t> offsets;
+		// Sizes of the decompressed tiles, equal to the compressed size for tiles stored uncompressed.
+		std::vector<std::size_t> rawSizes;
+
+		// Creates a layout with an empty tile table.
+		TileLayout(const FileHeader& header);
+
+		// Gets the region of the bitmap covered by a tile.
+		tref::Rect tileRect(std::size_t index) const noexcept;
+	};
+
+	template <class T> T readBinary(const std::byte*& ptr, const std::byte* end)
+	{
+		if ((end - ptr) < static_cast<std::ptrdiff_t>(sizeof(T))) {
+			throw tref::DecodingError{"Invalid .tref file."};
+		}
+
+		T value;
+		std::memcpy(&value, ptr, sizeof(T));
+		ptr += sizeof(T);
+		return value;
+	}
+
+	// Gets a memory resource, or the default one if it is null.
+	inline std::pmr::memory_resource* memoryResource(std::pmr::memory_resource* resource) noexcept
+	{
+		return resource != nullptr ? resource : std::pmr::get_default_resource();
+	}
+
+	// Gets the memory resource set in the decoding options, or the default one if there is none.
+	inline std::pmr::memory_resource* memoryResource(const tref::DecodeOptions& options) noexcept
+	{
+		return memoryResource(options.memoryResource);
+	}
+
+	// Allocates bitmap data from a memory resource, or with std::malloc if it is null, as expected by DecodedBitmap.
+	// Returns null if the size is 0.
+	std::byte* allocateBitmap(std::size_t size, std::pmr::memory_resource* resource);
+
+	// Gets a pointer to a field of statistics, or null if no statistics are collected.
+	template <class Stats, class T> T* statField(Stats* stats, T Stats::*field) noexcept
+	{
+		return stats != nullptr ? &(stats->*field) : nullptr;
+	}
+
+	// Reports a stage spanning a scope to a trace sink and adds its wall-clock time to a statistics field, unless
+	// they're null.
+	class StageTimer {
+	  public:
+		StageTimer(tref::TraceSink* trace, const char* stage, std::chrono::nanoseconds* total) noexcept
+			: _trace{trace}
+			, _stage{stage}
+			, _total{total}
+			, _start{total != nullptr ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{}}
+		{
+			if (_trace != nullptr) {
+				_trace->begin(_stage);
+			}
+		}
+
+		// Times a stage with the trace sink and statistics of decoding or encoding options.
+		template <class Options, class Stats>
+		StageTimer(const Options& options, const char* stage, std::chrono::nanoseconds Stats::*field) noexcept
+			: StageTimer{options.trace, stage, statField(options.stats, field)}
+		{
+		}
+
+		StageTimer(const StageTimer&) = delete;
+
+		~StageTimer() noexcept
+		{
+			if (_total != nullptr) {
+				*_total += std::chrono::steady_clock::now() - _start;
+			}
+			if (_trace != nullptr) {
+				_trace->end(_stage);
+			}
+		}
+
+	  private:
+		tref::TraceSink*                      _trace;
+		const char*                           _stage;
+		std::chrono::nanoseconds*             _total;
+		std::chrono::steady_clock::time_point _start;
+	};
+
+	// Memory resource for the scratch buffers of a decoding call, which counts allocations into the decoding statistics
+	// if they are collected.
+	class ScratchResource : public std::pmr::memory_resource {
+	  public:
+		explicit ScratchResource(const tref::DecodeOptions& options) noexcept
+			: _upstream{memoryResource(options)}, _stats{options.stats}, _allocations{0}
+		{
+		}
+
+		// Adds the allocations to the statistics, which are reset when decoding starts.
+		~ScratchResource() noexcept override
+		{
+			if (_stats != nullptr) {
+				_stats->allocations += _allocations;
+			}
+		}
+
+		// Gets the resource scratch buffers should use: this one if allocations are counted, the upstream one
+		// otherwise.
+		std::pmr::memory_resource* get() noexcept
+		{
+			return _stats != nullptr ? this : _upstream;
+		}
+
+	  private:
+		std::pmr::memory_resource* _upstream;
+		tref::DecodeStats*         _stats;
+		std::atomic<std::size_t>   _allocations;
+
+		void* do_allocate(std::size_t bytes, std::size_t alignment) override
+		{
+			++_allocations;
+			return _upstream->allocate(bytes, alignment);
+		}
+
+		void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override
+		{
+			_upstream->deallocate(p, bytes, alignment);
+		}
+
+		bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+		{
+			return this == &other;
+		}
+	};
+
+	// Records the sizes of a completed decoding in the decoding statistics, if they are collected.
+	void recordStats(const tref::DecodeOptions& options, std::size_t fileSize, std::size_t decompressedSize,
+					 const tref::DecodingInfo& info) noexcept;
+
+	// Runs a decoding function that takes a bitmap target, decoding into a bitmap allocated as set in the decoding
+	// options.
+	template <class Fn> tref::DecodingResult decodeToNewBitmap(const tref::DecodeOptions& options, Fn&& decode)
+	{
+		const tref::PixelFormat format{options.outputFormat};
+		tref::DecodedBitmap     bitmap{nullptr, 0, 0, format, options.memoryResource};
+
+		tref::DecodingInfo info{decode([&](unsigned int width, unsigned int height) {
+			const std::size_t size{std::size_t{width} * height * tref::bytesPerPixel(format)};
+			std::byte* const  data{allocateBitmap(size, options.memoryResource)};
+			if (options.stats != nullptr && data != nullptr) {
+				++options.stats->allocations;
+			}
+			bitmap = tref::DecodedBitmap{data, width, height, format, options.memoryResource};
+			return std::span<std::byte>{data, size};
+		})};
+		return tref::DecodingResult{info.lineSkip, std::move(info.glyphs), std::move(bitmap)};
+	}
+
+	// Gets the size of the preamble of a tref file from its 4-byte magic.
+	std::size_t fileHeaderSize(const std::byte* magic);
+
+	// Reads the preamble of a tref file.
+	FileHeader readFileHeader(const std::byte*& ptr, const std::byte* end);
+
+	// Decompresses the payload of a tref file into a scratch buffer, returning the preamble of the file. The scratch
+	// buffer is either a std::vector or a std::pmr::vector of bytes.
+	template <class Scratch> FileHeader decompressPayload(std::span<const std::byte> data, Scratch& scratch);
+
+	// Reads the tile table of a version 3 file.
+	void readTileTable(TileLayout& layout, const std::byte*& ptr, const std::byte* end);
+
+	// Reads the glyph table from decompressed glyph table data into a glyph map, replacing its contents. The nodes and
+	// buckets the map already has are reused, so reading a glyph table of the same size doesn't allocate.
+	void readGlyphTable(const std::byte*& ptr, const std::byte* end, std::uint32_t count,
+						const tref::DecodeOptions& options, tref::GlyphMap& glyphs);
+
+	// Checks that the metadata read from the payload matches the preamble.
+	void checkFileHeader(const FileHeader& header, std::int32_t lineSkip, std::uint32_t glyphCount,
+						 const qoi_desc& desc);
+
+	// Throws LimitError if the limits set in the decoding options are exceeded by the sizes given by a preamble.
+	void checkLimits(const FileHeader& header, const tref::DecodeOptions& options);
+
+	// Throws LimitError if a glyph count exceeds the limit set in the decoding options.
+	void checkGlyphLimit(std::uint32_t glyphCount, const tref::DecodeOptions& options);
+
+	// Throws LimitError if bitmap dimensions exceed the limit set in the decoding options.
+	void checkBitmapLimit(std::uint32_t width, std::uint32_t height, const tref::DecodeOptions& options);
+
+	// Throws CancellationError if a stop was requested through the decoding options.
+	void checkStop(const tref::DecodeOptions& options);
+
+	// Gets whether the decoding options request work to be done in parallel.
+	bool isParallel(const tref::DecodeOptions& options) noexcept;
+
+	// Gets whether the decoding options request the glyph table to be decoded concurrently with the bitmap.
+	bool isPipelined(const tref::DecodeOptions& options) noexcept;
+
+	// Pool of threads running tasks in the order they were posted. Tasks still queued when the pool is destroyed are
+	// run before its threads are joined.
+	class WorkerPool {
+	  public:
+		explicit WorkerPool(unsigned int threads);
+
+		// Queues a task. The task must not throw.
+		void post(std::function<void()> task);
+
+	  private:
+		std::mutex                        _mutex;
+		std::condition_variable_any       _available;
+		std::deque<std::function<void()>> _tasks;
+		// Declared last so the threads are stopped and joined before anything else is destroyed.
+		std::vector<std::jthread> _threads;
+
+		// Runs tasks until a stop is requested and no tasks are left.
+		void run(std::stop_token stop);
+	};
+
+	// Gets the pool running work that isn't given to an executor, which is created on first use with one thread per
+	// hardware thread.
+	WorkerPool& sharedPool();
+
+	// Calls task(i) for every i in [0, count), in parallel on the calling thread and either tasks given to an executor
+	// or up to threads - 1 tasks posted to the shared pool. Returns once all calls are complete, rethrowing the first
+	// exception thrown by a call.
+	void parallelFor(tref::Executor* executor, unsigned int threads, std::size_t count,
+					 const std::function<void(std::size_t)>& task);
+
+	// Runs a task on an executor, or the shared pool if there is none, while running another task on the calling
+	// thread. Returns once both are complete, rethrowing the exception thrown by a task if there is one.
+	void runConcurrently(tref::Executor* executor, const std::function<void()>& background,
+						 const std::function<void()>& foreground);
+
+	// Reads a glyph table entry.
+	std::pair<tref::Codepoint, tref::Glyph> readGlyphEntry(const std::byte*& ptr, const std::byte* end);
+
+	// Gets whether the decoding options select a subset of the glyphs.
+	bool filtersGlyphs(const tref::DecodeOptions& options) noexcept;
+
+	// Gets whether a codepoint is selected by the decoding options.
+	bool selectsGlyph(tref::Codepoint cp, const tref::DecodeOptions& options);
+
+	// Adds a glyph table entry to a glyph map if it's selected by the decoding options.
+	void addGlyph(tref::GlyphMap& glyphs, const std::pair<tref::Codepoint, tref::Glyph>& entry,
+				  const tref::DecodeOptions& options);
+
+	// Gets the region of the stored bitmap to output, making the glyphs relative to it if the bitmap is cropped.
+	tref::Rect outputRegion(tref::GlyphMap& glyphs, const qoi_desc& desc, const tref::DecodeOptions& options) noexcept;
+
+	// Reads the header of a QOI image and validates the bitmap size.
+	qoi_desc readQoiHeader(const std::byte*& ptr, const std::byte* end);
+
+	// Gets the maximum size of the QOI data of a 32bpp RGBA image, throwing EncodingError if it's too large to encode.
+	std::size_t maxQoiSize(unsigned int width, unsigned int height);
+
+	// Encodes a 32bpp RGBA image whose rows are stride bytes apart into QOI data, producing the same bytes as
+	// qoi_encode without staging them in a buffer of its own. out must have room for maxQoiSize() bytes. Returns the
+	// size of the QOI data.
+	std::size_t encodeQoi(const std::byte* pixels, unsigned int width, unsigned int height, std::size_t stride,
+						  std::byte* out) noexcept;
+
+	// Resumable decoder of QOI image chunks into 32bpp RGBA pixels.
+	class QoiDecoder {
+	  public:
+		QoiDecoder() noexcept;
+
+		// Decodes up to count pixels from the chunks in [it, end) into out. Only chunks that are fully contained in the
+		// range are decoded, so decoding can be resumed once more data is available. Returns the number of pixels
+		// written.
+		std::size_t decode(const std::byte*& it, const std::byte* end, std::byte* out, std::size_t count) noexcept;
+
+		// Fills pixels with the last decoded pixel value, used when the chunk data ends before the image is complete.
+		void fill(std::byte* out, std::size_t count) const noexcept;
+
+	  private:
+		struct Rgba {
+			std::uint8_t r, g, b, a;
+
+			// Gets the pixel bytes as a single value.
+			std::uint32_t value() const noexcept;
+
+			// Gets the position of the pixel in the index of previously seen pixels.
+			unsigned int hash() const noexcept;
+
+			// Writes the pixel bytes.
+			void write(std::byte* out) const noexcept;
+		};
+
+		// Applies a DIFF, LUMA, RGB or RGBA chunk to a pixel, given the first byte of the chunk and the following
+		// bytes.
+		static Rgba applyChunk(Rgba px, std::uint8_t b1, const std::uint8_t*& bytes) noexcept;
+
+		std::array<Rgba, 64> _index;
+		Rgba                 _px;
+		std::size_t          _run;
+	};
+
+	// Instruction sets the pixel kernels are specialized for, from least to most capable.
+	enum class SimdLevel {
+		SCALAR,
+		SSE4_2,
+		AVX2,
+		AVX512
+	};
+
+	// Signature of a pixel format conversion kernel.
+	using PixelKernel = void (*)(const std::byte* in, std::byte* out, std::size_t count) noexcept;
+
+	// Pixel format conversion kernels for one instruction set.
+	struct PixelKernels {
+		PixelKernel toBgra;
+		PixelKernel toA8;
+		PixelKernel toPremultipliedRgba;
+	};
+
+	// Gets the most capable instruction set supported by both the CPU and the operating system.
+	SimdLevel detectSimdLevel() noexcept;
+
+	// Selects the instruction set of the pixel kernels: the most capable one supported, unless a less capable one is
+	// forced through the TREF_SIMD environment variable (scalar, sse4.2, avx2 or avx512) for benchmarking.
+	SimdLevel selectSimdLevel() noexcept;
+
+	// Gets the pixel kernels for an instruction set, which must be supported (scalar ones on other architectures).
+	const PixelKernels& pixelKernels(SimdLevel level) noexcept;
+
+	// Gets the pixel kernels for the instruction set selected on first use.
+	const PixelKernels& pixelKernels() noexcept;
+
+	// Converts 32bpp RGBA pixels to another pixel format.
+	void convertPixels(tref::PixelFormat format, const std::byte* in, std::byte* out, std::size_t count) noexcept;
+
+	// Destination of decoded pixels: either a caller-provided buffer or a sink receiving batches of rows.
+	class PixelWriter {
+	  public:
+		// Creates a writer decoding into a buffer returned by a target callback, with staging buffers allocated from a
+		// memory resource.
+		PixelWriter(const tref::BitmapTarget& target, tref::PixelFormat format,
+					std::pmr::memory_resource* resource = std::pmr::get_default_resource()) noexcept;
+
+		// Creates a writer passing batches of rows to a sink.
+		PixelWriter(const tref::RowSink& sink, unsigned int batchRows, tref::PixelFormat format,
+					std::pmr::memory_resource* resource = std::pmr::get_default_resource()) noexcept;
+
+		// Prepares the writer for a stored bitmap of a given size, of which only a region is output.
+		void begin(unsigned int width, unsigned int height, const tref::Rect& region);
+
+		// Decodes as many pixels as possible from the chunks in [it, end), stopping once the rows of the stored bitmap
+		// before endRow are complete. Returns whether the bitmap is complete.
+		bool decode(QoiDecoder& qoi, const std::byte*& it, const std::byte* end, unsigned int endRow = UINT_MAX);
+
+		// Fills the rest of the bitmap with the last decoded pixel value.
+		void fill(const QoiDecoder& qoi);
+
+		// Writes already decoded RGBA pixels to the output, which must not be cropped.
+		void write(const std::byte* pixels, std::size_t count);
+
+		// Gets whether rows can be written out of order with writeRows().
+		bool random() const noexcept;
+
+		// Writes already decoded RGBA rows to a given row of the output, which must not be cropped. Only supported when
+		// writing to a buffer, and safe to call concurrently for different rows.
+		void writeRows(unsigned int row, const std::byte* pixels, unsigned int rows) const noexcept;
+
+		// Gets the memory resource used for scratch buffers.
+		std::pmr::memory_resource* resource() const noexcept;
+
+		// Gets the number of complete rows of the stored bitmap.
+		unsigned int row() const noexcept;
+
+	  private:
+		// Number of pixels decoded at once before being converted to the output format.
+		static constexpr std::size_t STAGING_PIXELS{1024};
+
+		const tref::BitmapTarget*   _target;
+		const tref::RowSink*        _sink;
+		unsigned int                _batchRows;
+		tref::PixelFormat           _format;
+		unsigned int                _storedWidth;
+		unsigned int                _width;
+		unsigned int                _height;
+		tref::Rect                  _region;
+		bool                        _cropped;
+		std::pmr::vector<std::byte> _batch;
+		std::pmr::vector<std::byte> _staging;
+		std::span<std::byte>        _out;
+		std::size_t                 _pixels;
+		std::size_t                 _written;
+		std::size_t                 _outStart;
+		unsigned int                _row;
+		std::size_t                 _rowDecoded;
+
+		// Decodes as many rows before endRow as possible when only a region of the stored bitmap is output.
+		bool decodeCropped(QoiDecoder& qoi, const std::byte*& it, const std::byte* end, unsigned int endRow);
+
+		// Writes the region part of a fully decoded row of the stored bitmap to the output.
+		void writeRow();
+
+		// Gets the number of pixels that can be written into the current output region.
+		std::size_t space() const noexcept;
+
+		// Gets a pointer to the next pixel to write in the current output region.
+		std::byte* next() const noexcept;
+
+		// Marks pixels in the current output region as written, passing full batches to the sink.
+		void commit(std::size_t count);
+	};
+
+	// Decompresses and reads the separately compressed glyph table of a version 3 file into a glyph map, as with
+	// readGlyphTable(). The scratch buffer is either a std::vector or a std::pmr::vector of bytes.
+	template <class Scratch>
+	void decodeGlyphTable(const FileHeader& header, std::span<const std::byte> data, Scratch& scratch,
+						  const tref::DecodeOptions& options, tref::GlyphMap& glyphs);
+
+	// Decodes rows of tiles into bands of RGBA rows covering the width of a region.
+	class BandDecoder {
+	  public:
+		// Creates a decoder for a region of a tiled bitmap, with buffers allocated from a memory resource. Stage times
+		// are only measured if timed is set.
+		BandDecoder(const TileLayout& layout, const tref::Rect& region, std::pmr::memory_resource* resource, bool timed,
+					tref::TraceSink* trace);
+
+		// Decodes the part of a row of tiles overlapping the region. Returns the first row of the band within the
+		// region.
+		unsigned int decode(unsigned int row, const std::function<std::span<const std::byte>(std::size_t)>& tileData);
+
+		// Gets the pixels of the last decoded band.
+		const std::byte* pixels() const noexcept;
+
+		// Gets the number of rows in the last decoded band.
+		unsigned int rows() const noexcept;
+
+		// Adds the time spent decompressing and decoding tiles to the statistics.
+		void addTimes(tref::DecodeStats& stats) const noexcept;
+
+	  private:
+		const TileLayout&           _layout;
+		tref::Rect                  _region;
+		bool                        _timed;
+		tref::TraceSink*            _trace;
+		std::pmr::vector<std::byte> _scratch;
+		std::pmr::vector<std::byte> _tile;
+		std::pmr::vector<std::byte> _band;
+		unsigned int                _rows;
+		std::chrono::nanoseconds    _lz4Time;
+		std::chrono::nanoseconds    _qoiTime;
+	};
+
+	// Decodes the region of a tiled bitmap through a pixel writer. The compressed data of the tiles overlapping the
+	// region is obtained from a callback, which is called in increasing tile order unless rows of tiles are decoded in
+	// parallel using the threads or executor of the decoding options. The decoding options are also checked for
+	// cancellation. The stages of decoding the tiles are reported to the trace sink and added to the statistics unless
+	// they are null.
+	void decodeTiles(const TileLayout& layout, const tref::Rect& region, PixelWriter& writer,
+					 const std::function<std::span<const std::byte>(std::size_t)>& tileData, tref::DecodeStats* stats,
+					 tref::TraceSink* trace, const tref::DecodeOptions* options = nullptr);
+
+	// Incremental decompressor of a single LZ4 block that keeps only a sliding window of the decompressed data.
+	class Lz4Stream {
+	  public:
+		// Creates a stream that decompresses a block of a known decompressed size, with its window allocated from a
+		// memory resource.
+		explicit Lz4Stream(std::size_t size, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+		// Decompresses as much of the input as fits into the window. Returns the number of input bytes consumed.
+		std::size_t feed(std::span<const std::byte> input);
+
+		// Gets the decompressed data that wasn't consumed yet.
+		std::span<const std::byte> available() const noexcept;
+
+		// Gets the offset of the available data within the decompressed block.
+		std::size_t offset() const noexcept;
+
+		// Marks decompressed data as consumed.
+		void consume(std::size_t count) noexcept;
+
+		// Gets whether the whole block was decompressed.
+		bool done() const noexcept;
+
+	  private:
+		enum class State : std::uint8_t {
+			TOKEN,
+			LITERAL_LENGTH,
+			LITERALS,
+			OFFSET,
+			MATCH_LENGTH,
+			MATCH
+		};
+
+		std::pmr::vector<std::byte> _window;
+		std::size_t                 _windowOffset;
+		std::size_t                 _read;
+		std::size_t                 _write;
+		std::size_t                 _size;
+		State                       _state;
+		std::uint8_t                _token;
+		std::uint8_t                _offsetBytes;
+		std::size_t                 _matchOffset;
+		std::size_t                 _length;
+
+		// Discards data that is no longer needed from the front of the window.
+		void compact() noexcept;
+
+		// Decompresses whole sequences at once while they are fully contained in the input, fit into the window and are
+		// valid, which avoids going through the states one at a time. Returns the number of bytes decompressed; the
+		// sequence that stopped it is left to the states.
+		std::size_t decodeSequences(const std::byte*& it, const std::byte* end) noexcept;
+	};
+} // namespace tref::detail
\ No newline at end of file
@@ -0,0 +1,134 @@
+#include "../include/tref/tref.hpp"
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+tref::MappedFile::MappedFile(const std::filesystem::path& path, AccessHint hint)
+	: _data{nullptr}, _size{0}
+{
+	const DWORD flags{hint == AccessHint::SEQUENTIAL ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_ATTRIBUTE_NORMAL};
+	HANDLE      file{CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, flags, nullptr)};
+	if (file == INVALID_HANDLE_VALUE) {
+		throw FileError{"Failed to open .tref file."};
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size)) {
+		CloseHandle(file);
+		throw FileError{"Failed to get .tref file size."};
+	}
+	if (size.QuadPart == 0) {
+		CloseHandle(file);
+		return;
+	}
+
+	HANDLE mapping{CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr)};
+	CloseHandle(file);
+	if (mapping == nullptr) {
+		throw FileError{"Failed to map .tref file."};
+	}
+	_data = static_cast<const std::byte*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	CloseHandle(mapping);
+	if (_data == nullptr) {
+		throw FileError{"Failed to map .tref file."};
+	}
+	_size = static_cast<std::size_t>(size.QuadPart);
+
+	if (hint == AccessHint::WILL_NEED) {
+		WIN32_MEMORY_RANGE_ENTRY range{const_cast<std::byte*>(_data), _size};
+		PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+	}
+}
+
+tref::MappedFile::~MappedFile() noexcept
+{
+	if (_data != nullptr) {
+		UnmapViewOfFile(_data);
+	}
+}
+#else
+tref::MappedFile::MappedFile(const std::filesystem::path& path, AccessHint hint)
+	: _data{nullptr}, _size{0}
+{
+	const int fd{open(path.c_str(), O_RDONLY | O_CLOEXEC)};
+	if (fd == -1) {
+		throw FileError{"Failed to open .tref file."};
+	}
+
+	struct stat info;
+	if (fstat(fd, &info) == -1) {
+		close(fd);
+		throw FileError{"Failed to get .tref file size."};
+	}
+	if (info.st_size == 0) {
+		close(fd);
+		return;
+	}
+
+	void* mapping{mmap(nullptr, static_cast<std::size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0)};
+	close(fd);
+	if (mapping == MAP_FAILED) {
+		throw FileError{"Failed to map .tref file."};
+	}
+	_data = static_cast<const std::byte*>(mapping);
+	_size = static_cast<std::size_t>(info.st_size);
+
+	switch (hint) {
+	case AccessHint::NORMAL:
+		break;
+	case AccessHint::SEQUENTIAL:
+		madvise(mapping, _size, MADV_SEQUENTIAL);
+		break;
+	case AccessHint::WILL_NEED:
+		madvise(mapping, _size, MADV_WILLNEED);
+		break;
+	}
+}
+
+tref::MappedFile::~MappedFile() noexcept
+{
+	if (_data != nullptr) {
+		munmap(const_cast<std::byte*>(_data), _size);
+	}
+}
+#endif
+
+tref::MappedFile::MappedFile(MappedFile&& r) noexcept
+	: _data{std::exchange(r._data, nullptr)}, _size{std::exchange(r._size, 0)}
+{
+}
+
+tref::MappedFile& tref::MappedFile::operator=(MappedFile&& r) noexcept
+{
+	MappedFile old{std::move(r)};
+	std::swap(_data, old._data);
+	std::swap(_size, old._size);
+	return *this;
+}
+
+std::span<const std::byte> tref::MappedFile::data() const noexcept
+{
+	return {_data, _size};
+}
+
+tref::DecodingResult tref::loadFile(const std::filesystem::path& path, AccessHint hint, const DecodeOptions& options)
+{
+	const MappedFile file{path, hint};
+	return decode(file.data(), options);
+}
+
+tref::ProbeInfo tref::probeFile(const std::filesystem::path& path)
+{
+	const MappedFile file{path, AccessHint::NORMAL};
+	return probe(file.data());
+}
\ No newline at end of file
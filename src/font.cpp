@@ -0,0 +1,233 @@
+#include "common.hpp"
+#include <algorithm>
+
+namespace tref::detail {
+	// Amount of compressed data fed to the decompressor at once when decoding the glyph table.
+	inline constexpr std::size_t GLYPH_TABLE_CHUNK_SIZE{4096};
+} // namespace tref::detail
+
+struct tref::Font::Tiles : detail::TileLayout {
+	using TileLayout::TileLayout;
+};
+
+tref::Font::Font(std::vector<std::byte> data, const DecodeOptions& options)
+	: _data{std::move(data)}
+	, _glyphs{detail::memoryResource(options)}
+	, _format{options.outputFormat}
+	, _resource{options.memoryResource}
+{
+	const std::byte*         it{_data.data()};
+	const std::byte*         end{_data.data() + _data.size()};
+	const detail::FileHeader header{detail::readFileHeader(it, end)};
+	detail::checkLimits(header, options);
+	if (header.version == 3) {
+		_tiles = std::make_unique<Tiles>(header);
+		detail::readTileTable(*_tiles, it, end);
+		if (static_cast<std::size_t>(end - it) < header.glyphTableSize ||
+			static_cast<std::size_t>(end - it) - header.glyphTableSize < _tiles->offsets.back()) {
+			throw DecodingError{"Invalid .tref file."};
+		}
+
+		std::pmr::vector<std::byte> scratch{detail::memoryResource(options)};
+		detail::decodeGlyphTable(header, {it, header.glyphTableSize}, scratch, options, _glyphs);
+		_lineSkip     = header.lineSkip;
+		_storedWidth  = header.width;
+		_storedHeight = header.height;
+		_region       = detail::outputRegion(_glyphs, qoi_desc{header.width, header.height, 4, QOI_SRGB}, options);
+		_bitmapOffset = it + header.glyphTableSize - _data.data();
+		return;
+	}
+
+	// Only the payload up to the QOI chunks is decompressed here, the rest is left for bitmap().
+	detail::Lz4Stream lz4{header.rawSize, detail::memoryResource(options)};
+	const auto        pull{[&](std::size_t count) {
+		while (lz4.available().size() < count) {
+			if (lz4.done() || it == end) {
+				throw DecodingError{"Invalid .tref file."};
+			}
+			it += lz4.feed({it, std::min(static_cast<std::size_t>(end - it), detail::GLYPH_TABLE_CHUNK_SIZE)});
+		}
+		return lz4.available();
+	}};
+
+	std::span<const std::byte> payload{pull(8)};
+	const std::byte*           pit{payload.data()};
+	_lineSkip = detail::readBinary<std::int32_t>(pit, payload.data() + payload.size());
+	const std::uint32_t count{detail::readBinary<std::uint32_t>(pit, payload.data() + payload.size())};
+	lz4.consume(8);
+	if ((header.rawSize - 8) / detail::GLYPH_ENTRY_SIZE < count) {
+		throw DecodingError{"Invalid .tref file."};
+	}
+	detail::checkGlyphLimit(count, options);
+
+	if (!detail::filtersGlyphs(options)) {
+		_glyphs.reserve(count);
+	}
+	for (std::uint32_t i = 0; i < count;) {
+		payload = pull(detail::GLYPH_ENTRY_SIZE);
+		pit     = payload.data();
+		for (; i < count &&
+			   payload.data() + payload.size() - pit >= static_cast<std::ptrdiff_t>(detail::GLYPH_ENTRY_SIZE);
+			 ++i) {
+			detail::addGlyph(_glyphs, detail::readGlyphEntry(pit, payload.data() + payload.size()), options);
+		}
+		lz4.consume(pit - payload.data());
+	}
+
+	payload = pull(detail::QOI_HEADER_BYTES);
+	pit     = payload.data();
+	const qoi_desc desc{detail::readQoiHeader(pit, payload.data() + payload.size())};
+	lz4.consume(detail::QOI_HEADER_BYTES);
+	detail::checkFileHeader(header, _lineSkip, count, desc);
+	detail::checkBitmapLimit(desc.width, desc.height, options);
+	if (header.rawSize - lz4.offset() < detail::QOI_END_MARKER_BYTES) {
+		throw DecodingError{"Failed to decode .tref file image data."};
+	}
+
+	_storedWidth  = desc.width;
+	_storedHeight = desc.height;
+	_region       = detail::outputRegion(_glyphs, desc, options);
+	_bitmapOffset = lz4.offset();
+}
+
+tref::Font::Font(Font&& r) noexcept
+	: _data{std::move(r._data)}
+	, _lineSkip{r._lineSkip}
+	, _glyphs{std::move(r._glyphs)}
+	, _format{r._format}
+	, _storedWidth{r._storedWidth}
+	, _storedHeight{r._storedHeight}
+	, _region{r._region}
+	, _bitmapOffset{r._bitmapOffset}
+	, _resource{r._resource}
+	, _tiles{std::move(r._tiles)}
+	, _bitmap{std::move(r._bitmap)}
+{
+}
+
+tref::Font::~Font() noexcept = default;
+
+tref::Font& tref::Font::operator=(Font&& r) noexcept
+{
+	if (this != &r) {
+		_data         = std::move(r._data);
+		_lineSkip     = r._lineSkip;
+		_glyphs       = std::move(r._glyphs);
+		_format       = r._format;
+		_storedWidth  = r._storedWidth;
+		_storedHeight = r._storedHeight;
+		_region       = r._region;
+		_bitmapOffset = r._bitmapOffset;
+		_resource     = r._resource;
+		_tiles        = std::move(r._tiles);
+		_bitmap       = std::move(r._bitmap);
+	}
+	return *this;
+}
+
+std::int32_t tref::Font::lineSkip() const noexcept
+{
+	return _lineSkip;
+}
+
+const tref::GlyphMap& tref::Font::glyphs() const noexcept
+{
+	return _glyphs;
+}
+
+unsigned int tref::Font::width() const noexcept
+{
+	return _region.width;
+}
+
+unsigned int tref::Font::height() const noexcept
+{
+	return _region.height;
+}
+
+const tref::DecodedBitmap& tref::Font::bitmap() const
+{
+	std::lock_guard lock{_mutex};
+	return decodeBitmap();
+}
+
+const tref::DecodedBitmap& tref::Font::decodeBitmap() const
+{
+	if (_bitmap == nullptr) {
+		const std::size_t size{std::size_t{_region.width} * _region.height * bytesPerPixel(_format)};
+		std::byte* const  data{detail::allocateBitmap(size, _resource)};
+		DecodedBitmap     pixels{data, _region.width, _region.height, _format, _resource};
+
+		const BitmapTarget  target{[&](unsigned int, unsigned int) { return std::span<std::byte>{data, size}; }};
+		detail::PixelWriter writer{target, _format, detail::memoryResource(_resource)};
+		if (_tiles != nullptr) {
+			detail::decodeTiles(*_tiles, _region, writer, [&](std::size_t index) {
+				return std::span<const std::byte>{_data}.subspan(_bitmapOffset + _tiles->offsets[index],
+																 _tiles->offsets[index + 1] - _tiles->offsets[index]);
+			}, nullptr, nullptr);
+		}
+		else {
+			std::pmr::vector<std::byte> scratch{detail::memoryResource(_resource)};
+			detail::decompressPayload(_data, scratch);
+
+			const std::byte*   it{scratch.data() + _bitmapOffset};
+			detail::QoiDecoder qoi;
+			writer.begin(_storedWidth, _storedHeight, _region);
+			if (!writer.decode(qoi, it, scratch.data() + scratch.size() - detail::QOI_END_MARKER_BYTES)) {
+				writer.fill(qoi);
+			}
+		}
+		_bitmap = std::make_unique<DecodedBitmap>(std::move(pixels));
+	}
+	return *_bitmap;
+}
+
+tref::DecodedBitmap tref::Font::glyphPixels(Codepoint cp) const
+{
+	// The texture box is clamped to the bitmap in case it's out of bounds.
+	const Glyph&       glyph{_glyphs.at(cp)};
+	const unsigned int x{std::min<unsigned int>(glyph.x, _region.width)};
+	const unsigned int y{std::min<unsigned int>(glyph.y, _region.height)};
+	const unsigned int width{std::min<unsigned int>(glyph.width, _region.width - x)};
+	const unsigned int height{std::min<unsigned int>(glyph.height, _region.height - y)};
+	const Rect         rect{x, y, width, height};
+
+	const std::size_t rowSize{std::size_t{rect.width} * bytesPerPixel(_format)};
+	const std::size_t size{rowSize * rect.height};
+	std::byte* const  data{detail::allocateBitmap(size, _resource)};
+	DecodedBitmap     pixels{data, rect.width, rect.height, _format, _resource};
+
+	if (_tiles != nullptr) {
+		const BitmapTarget  target{[&](unsigned int, unsigned int) { return std::span<std::byte>{data, size}; }};
+		detail::PixelWriter writer{target, _format, detail::memoryResource(_resource)};
+		const Rect          stored{rect.x + _region.x, rect.y + _region.y, rect.width, rect.height};
+		detail::decodeTiles(*_tiles, stored, writer, [&](std::size_t index) {
+			return std::span<const std::byte>{_data}.subspan(_bitmapOffset + _tiles->offsets[index],
+															 _tiles->offsets[index + 1] - _tiles->offsets[index]);
+		}, nullptr, nullptr);
+	}
+	else {
+		// The lock is held while copying so that releasePixels() can't free the bitmap under us.
+		std::lock_guard      lock{_mutex};
+		const DecodedBitmap& bitmap{decodeBitmap()};
+		const std::size_t    stride{std::size_t{_region.width} * bytesPerPixel(_format)};
+		for (unsigned int row = 0; row < rect.height; ++row) {
+			std::memcpy(data + row * rowSize,
+						bitmap.data().data() + (rect.y + row) * stride + std::size_t{rect.x} * bytesPerPixel(_format),
+						rowSize);
+		}
+	}
+	return pixels;
+}
+
+bool tref::Font::hasPixels() const noexcept
+{
+	std::lock_guard lock{_mutex};
+	return _bitmap != nullptr;
+}
+
+void tref::Font::releasePixels() noexcept
+{
+	std::lock_guard lock{_mutex};
+	_bitmap.reset();
+}
\ No newline at end of file
@@ -0,0 +1,377 @@
+#include "common.hpp"
+#include <algorithm>
+#include <optional>
+
+namespace tref::detail {
+	// Stages of incremental decoding, in order.
+	enum class Stage : std::uint8_t {
+		// Reading the preamble, and the tile table of tiled files.
+		HEADER,
+		// Reading the line skip and glyph count at the start of the payload of untiled files.
+		GLYPH_COUNT,
+		// Reading the glyph table entries.
+		GLYPHS,
+		// Reading the QOI header of untiled files.
+		BITMAP_HEADER,
+		// Decoding the QOI chunks of untiled files.
+		PIXELS,
+		// Decoding the tiles of tiled files.
+		TILES,
+		DONE
+	};
+
+	// State of an incremental decoding, advanced one budgeted step at a time.
+	struct IncrementalDecoding {
+		std::span<const std::byte> data;
+		DecodeOptions              options;
+		Stage                      stage;
+		// Input data that wasn't decompressed yet, and the end of the data consumed so far.
+		std::span<const std::byte> input;
+		const std::byte*           position;
+		FileHeader                 header;
+		std::uint32_t              glyphCount;
+		std::uint32_t              glyphsLeft;
+		DecodingInfo               info;
+		DecodedBitmap              bitmap;
+		BitmapTarget               target;
+		// Scratch state, which is destroyed once decoding is complete. The resource must outlive the others.
+		std::optional<ScratchResource> resource;
+		std::optional<Lz4Stream>       lz4;
+		std::optional<PixelWriter>     writer;
+		QoiDecoder                     qoi;
+		std::size_t                    chunksEnd;
+		std::optional<TileLayout>      layout;
+		std::optional<BandDecoder>     band;
+		const std::byte*               tiles;
+		unsigned int                   tileRow;
+		unsigned int                   lastTileRow;
+
+		IncrementalDecoding(std::span<const std::byte> data, DecodeOptions options)
+			: data{data}
+			, options{std::move(options)}
+			, stage{Stage::HEADER}
+			, position{data.data()}
+			, header{}
+			, glyphCount{0}
+			, glyphsLeft{0}
+			, info{0, GlyphMap{memoryResource(this->options)}, 0, 0}
+			, bitmap{nullptr, 0, 0, this->options.outputFormat, this->options.memoryResource}
+			, target{[this](unsigned int width, unsigned int height) {
+				const std::size_t size{std::size_t{width} * height * bytesPerPixel(this->options.outputFormat)};
+				std::byte* const  pixels{allocateBitmap(size, this->options.memoryResource)};
+				if (this->options.stats != nullptr && pixels != nullptr) {
+					++this->options.stats->allocations;
+				}
+				bitmap = DecodedBitmap{pixels, width, height, this->options.outputFormat, this->options.memoryResource};
+				return std::span<std::byte>{pixels, size};
+			}}
+			, chunksEnd{0}
+			, tiles{nullptr}
+			, tileRow{0}
+			, lastTileRow{0}
+		{
+		}
+
+		// Does the work allowed by a budget.
+		DecodeProgress step(StepBudget budget)
+		{
+			budget.lz4Bytes = std::max(budget.lz4Bytes, std::size_t{1});
+			budget.glyphs   = std::max(budget.glyphs, std::uint32_t{1});
+			budget.rows     = std::max(budget.rows, 1U);
+
+			if (stage != Stage::DONE) {
+				checkStop(options);
+			}
+			while (stage != Stage::DONE && advance(budget)) {
+			}
+			return DecodeProgress{static_cast<std::size_t>(position - data.data()), data.size(), stage == Stage::DONE};
+		}
+
+		// Continues the current stage. Returns whether it is complete, or false if the budget ran out first.
+		bool advance(StepBudget& budget)
+		{
+			switch (stage) {
+			case Stage::HEADER:
+				readHeader();
+				return true;
+			case Stage::GLYPH_COUNT:
+				return readGlyphCount(budget);
+			case Stage::GLYPHS:
+				return readGlyphs(budget);
+			case Stage::BITMAP_HEADER:
+				return readBitmapHeader(budget);
+			case Stage::PIXELS:
+				return decodePixels(budget);
+			case Stage::TILES:
+				return decodeTiles(budget);
+			case Stage::DONE:
+				break;
+			}
+			return true;
+		}
+
+		// Reads the preamble and sets up decompression of the glyph table.
+		void readHeader()
+		{
+			if (options.stats != nullptr) {
+				*options.stats = {};
+			}
+			resource.emplace(options);
+			writer.emplace(target, options.outputFormat, resource->get());
+
+			const StageTimer timer{options.trace, HEADER_STAGE, nullptr};
+			const std::byte* it{data.data()};
+			const std::byte* end{data.data() + data.size()};
+			header = readFileHeader(it, end);
+			checkLimits(header, options);
+			if (header.version != 3) {
+				lz4.emplace(header.rawSize, resource->get());
+				input    = {it, end};
+				position = it;
+				stage    = Stage::GLYPH_COUNT;
+				return;
+			}
+
+			layout.emplace(header);
+			readTileTable(*layout, it, end);
+			if (static_cast<std::size_t>(end - it) < header.glyphTableSize ||
+				static_cast<std::size_t>(end - it) - header.glyphTableSize < layout->offsets.back()) {
+				throw DecodingError{"Invalid .tref file."};
+			}
+			lz4.emplace(std::size_t{header.glyphCount} * GLYPH_ENTRY_SIZE, resource->get());
+			input         = {it, header.glyphTableSize};
+			position      = it;
+			tiles         = it + header.glyphTableSize;
+			info.lineSkip = header.lineSkip;
+			glyphCount    = header.glyphCount;
+			startGlyphs();
+		}
+
+		// Reads the line skip and glyph count from the payload of an untiled file.
+		bool readGlyphCount(StepBudget& budget)
+		{
+			if (!pull(8, budget.lz4Bytes)) {
+				return false;
+			}
+			const std::span<const std::byte> payload{lz4->available()};
+			const std::byte*                 it{payload.data()};
+			info.lineSkip = readBinary<std::int32_t>(it, payload.data() + payload.size());
+			glyphCount    = readBinary<std::uint32_t>(it, payload.data() + payload.size());
+			lz4->consume(8);
+			if ((header.rawSize - 8) / GLYPH_ENTRY_SIZE < glyphCount) {
+				throw DecodingError{"Invalid .tref file."};
+			}
+			checkGlyphLimit(glyphCount, options);
+			startGlyphs();
+			return true;
+		}
+
+		// Starts reading the glyph table entries.
+		void startGlyphs()
+		{
+			if (!filtersGlyphs(options)) {
+				info.glyphs.reserve(glyphCount);
+			}
+			glyphsLeft = glyphCount;
+			stage      = Stage::GLYPHS;
+		}
+
+		// Reads glyph table entries.
+		bool readGlyphs(StepBudget& budget)
+		{
+			while (glyphsLeft > 0) {
+				if (budget.glyphs == 0 || !pull(GLYPH_ENTRY_SIZE, budget.lz4Bytes)) {
+					return false;
+				}
+
+				const StageTimer                 timer{options, GLYPH_TABLE_STAGE, &DecodeStats::glyphTime};
+				const std::span<const std::byte> payload{lz4->available()};
+				const std::byte*                 it{payload.data()};
+				const std::uint32_t              count{static_cast<std::uint32_t>(
+					std::min<std::size_t>({glyphsLeft, budget.glyphs, payload.size() / GLYPH_ENTRY_SIZE}))};
+				for (std::uint32_t i = 0; i < count; ++i) {
+					addGlyph(info.glyphs, readGlyphEntry(it, payload.data() + payload.size()), options);
+				}
+				lz4->consume(it - payload.data());
+				glyphsLeft -= count;
+				budget.glyphs -= count;
+			}
+
+			if (header.version == 3) {
+				startTiles();
+			}
+			else {
+				stage = Stage::BITMAP_HEADER;
+			}
+			return true;
+		}
+
+		// Reads the QOI header of an untiled file and starts decoding its chunks.
+		bool readBitmapHeader(StepBudget& budget)
+		{
+			if (!pull(QOI_HEADER_BYTES, budget.lz4Bytes)) {
+				return false;
+			}
+			const std::byte* it{lz4->available().data()};
+			const qoi_desc   desc{readQoiHeader(it, it + QOI_HEADER_BYTES)};
+			lz4->consume(QOI_HEADER_BYTES);
+			checkFileHeader(header, info.lineSkip, glyphCount, desc);
+			checkBitmapLimit(desc.width, desc.height, options);
+			if (header.rawSize - lz4->offset() < QOI_END_MARKER_BYTES) {
+				throw DecodingError{"Failed to decode .tref file image data."};
+			}
+
+			const Rect region{outputRegion(info.glyphs, desc, options)};
+			writer->begin(desc.width, desc.height, region);
+			info.width  = region.width;
+			info.height = region.height;
+			chunksEnd   = header.rawSize - QOI_END_MARKER_BYTES;
+			stage       = Stage::PIXELS;
+			return true;
+		}
+
+		// Decodes QOI chunks of an untiled file.
+		bool decodePixels(StepBudget& budget)
+		{
+			while (true) {
+				{
+					const StageTimer                 timer{options, QOI_DECODE_STAGE, &DecodeStats::qoiTime};
+					const std::span<const std::byte> available{lz4->available()};
+					const std::span<const std::byte> chunks{
+						available.first(std::min(available.size(), chunksEnd - lz4->offset()))};
+					const std::byte*   it{chunks.data()};
+					const unsigned int row{writer->row()};
+					const unsigned int endRow{budget.rows > UINT_MAX - row ? UINT_MAX : row + budget.rows};
+					const bool         complete{writer->decode(qoi, it, chunks.data() + chunks.size(), endRow)};
+					lz4->consume(it - chunks.data());
+					budget.rows -= writer->row() - row;
+					if (complete) {
+						break;
+					}
+					else if (budget.rows == 0) {
+						return false;
+					}
+					else if (lz4->offset() + lz4->available().size() >= chunksEnd) {
+						writer->fill(qoi);
+						break;
+					}
+				}
+				if (budget.lz4Bytes == 0) {
+					return false;
+				}
+				feed(budget.lz4Bytes);
+			}
+			finish();
+			return true;
+		}
+
+		// Sets up decoding of the tiles of a tiled file overlapping the output region.
+		void startTiles()
+		{
+			lz4.reset();
+			const Rect region{outputRegion(info.glyphs, qoi_desc{header.width, header.height, 4, QOI_SRGB}, options)};
+			writer->begin(region.width, region.height, Rect{0, 0, region.width, region.height});
+			info.width  = region.width;
+			info.height = region.height;
+			if (region.width == 0 || region.height == 0) {
+				finish();
+				return;
+			}
+
+			band.emplace(*layout, region, resource->get(), options.stats != nullptr, options.trace);
+			tileRow     = region.y / layout->tileHeight;
+			lastTileRow = (region.y + region.height - 1) / layout->tileHeight;
+			stage       = Stage::TILES;
+		}
+
+		// Decodes rows of tiles of a tiled file.
+		bool decodeTiles(StepBudget& budget)
+		{
+			const auto tileData{[&](std::size_t index) {
+				return std::span<const std::byte>{tiles + layout->offsets[index], tiles + layout->offsets[index + 1]};
+			}};
+			for (; tileRow <= lastTileRow; ++tileRow) {
+				if (budget.rows == 0) {
+					return false;
+				}
+				band->decode(tileRow, tileData);
+				writer->write(band->pixels(), std::size_t{band->rows()} * info.width);
+				budget.rows -= std::min(budget.rows, band->rows());
+				position = tiles + layout->offsets[(std::size_t{tileRow} + 1) * layout->columns];
+			}
+
+			if (options.stats != nullptr) {
+				band->addTimes(*options.stats);
+			}
+			finish();
+			return true;
+		}
+
+		// Decompresses input until count bytes of payload are available. Returns false if the budget ran out first.
+		bool pull(std::size_t count, std::size_t& budget)
+		{
+			while (lz4->available().size() < count) {
+				if (lz4->done()) {
+					throw DecodingError{"Invalid .tref file."};
+				}
+				else if (budget == 0) {
+					return false;
+				}
+				feed(budget);
+			}
+			return true;
+		}
+
+		// Decompresses as much input as allowed by a budget.
+		void feed(std::size_t& budget)
+		{
+			if (input.empty()) {
+				throw DecodingError{"Unexpected end of .tref file."};
+			}
+			const StageTimer  timer{options, LZ4_DECOMPRESS_STAGE, &DecodeStats::lz4Time};
+			const std::size_t fed{lz4->feed(input.first(std::min(budget, input.size())))};
+			input    = input.subspan(fed);
+			position = input.data();
+			budget -= fed;
+		}
+
+		// Records the statistics and frees the scratch state.
+		void finish()
+		{
+			recordStats(options, data.size(), header.rawSize, info);
+			band.reset();
+			layout.reset();
+			writer.reset();
+			lz4.reset();
+			resource.reset();
+			stage = Stage::DONE;
+		}
+	};
+} // namespace tref::detail
+
+struct tref::IncrementalDecoder::Impl : detail::IncrementalDecoding {
+	using IncrementalDecoding::IncrementalDecoding;
+};
+
+tref::IncrementalDecoder::IncrementalDecoder(std::span<const std::byte> data, DecodeOptions options)
+	: _impl{std::make_unique<Impl>(data, std::move(options))}
+{
+}
+
+tref::IncrementalDecoder::IncrementalDecoder(IncrementalDecoder&& r) noexcept = default;
+
+tref::IncrementalDecoder::~IncrementalDecoder() noexcept = default;
+
+tref::IncrementalDecoder& tref::IncrementalDecoder::operator=(IncrementalDecoder&& r) noexcept = default;
+
+tref::DecodeProgress tref::IncrementalDecoder::step(const StepBudget& budget)
+{
+	return _impl->step(budget);
+}
+
+tref::DecodingResult tref::IncrementalDecoder::result()
+{
+	while (!step(StepBudget{SIZE_MAX, UINT32_MAX, UINT_MAX}).done) {
+	}
+	return DecodingResult{_impl->info.lineSkip, std::move(_impl->info.glyphs), std::move(_impl->bitmap)};
+}
\ No newline at end of file
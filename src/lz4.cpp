@@ -0,0 +1,231 @@
+#include "common.hpp"
+#include <algorithm>
+
+namespace tref::detail {
+	// Maximum distance of an LZ4 match.
+	inline constexpr std::size_t LZ4_HISTORY_SIZE{64 * 1024};
+
+	// Amount of space in the window for newly decompressed data.
+	inline constexpr std::size_t LZ4_OUTPUT_SIZE{64 * 1024};
+
+	// Minimum length of an LZ4 match.
+	inline constexpr std::size_t LZ4_MIN_MATCH{4};
+
+	// Size of the copies made when decompressing whole sequences, which must be free at the end of the window.
+	inline constexpr std::size_t LZ4_COPY_SLACK{16};
+
+	Lz4Stream::Lz4Stream(std::size_t size, std::pmr::memory_resource* resource)
+		: _window(std::min(size, LZ4_HISTORY_SIZE + LZ4_OUTPUT_SIZE), resource)
+		, _windowOffset{0}
+		, _read{0}
+		, _write{0}
+		, _size{size}
+		, _state{State::TOKEN}
+		, _token{0}
+		, _offsetBytes{0}
+		, _matchOffset{0}
+		, _length{0}
+	{
+	}
+
+	std::size_t Lz4Stream::feed(std::span<const std::byte> input)
+	{
+		const std::byte* it{input.data()};
+		const std::byte* end{input.data() + input.size()};
+
+		while (!done()) {
+			if (_write == _window.size()) {
+				compact();
+			}
+			const std::size_t room{std::min(_window.size() - _write, _size - (_windowOffset + _write))};
+
+			switch (_state) {
+			case State::TOKEN:
+				if (decodeSequences(it, end) > 0) {
+					break;
+				}
+				else if (it == end) {
+					return it - input.data();
+				}
+				_token  = std::to_integer<std::uint8_t>(*it++);
+				_length = _token >> 4;
+				_state  = _length == 15 ? State::LITERAL_LENGTH : State::LITERALS;
+				break;
+			case State::LITERAL_LENGTH: {
+				if (it == end) {
+					return it - input.data();
+				}
+				const std::uint8_t byte{std::to_integer<std::uint8_t>(*it++)};
+				_length += byte;
+				if (byte != 255) {
+					_state = State::LITERALS;
+				}
+				break;
+			}
+			case State::LITERALS: {
+				if (_length > _size - (_windowOffset + _write)) {
+					throw tref::DecodingError{"Decompression of .tref file failed."};
+				}
+				const std::size_t count{std::min({_length, room, static_cast<std::size_t>(end - it)})};
+				if (_length > 0 && count == 0) {
+					return it - input.data();
+				}
+				std::memcpy(_window.data() + _write, it, count);
+				it += count;
+				_write += count;
+				_length -= count;
+				if (_length == 0) {
+					_state       = State::OFFSET;
+					_offsetBytes = 0;
+					_matchOffset = 0;
+				}
+				break;
+			}
+			case State::OFFSET:
+				if (it == end) {
+					return it - input.data();
+				}
+				_matchOffset |= std::to_integer<std::size_t>(*it++) << (8 * _offsetBytes++);
+				if (_offsetBytes == 2) {
+					if (_matchOffset == 0 || _matchOffset > _windowOffset + _write) {
+						throw tref::DecodingError{"Decompression of .tref file failed."};
+					}
+					_length = (_token & 0xF) + LZ4_MIN_MATCH;
+					_state  = (_token & 0xF) == 15 ? State::MATCH_LENGTH : State::MATCH;
+				}
+				break;
+			case State::MATCH_LENGTH: {
+				if (it == end) {
+					return it - input.data();
+				}
+				const std::uint8_t byte{std::to_integer<std::uint8_t>(*it++)};
+				_length += byte;
+				if (byte != 255) {
+					_state = State::MATCH;
+				}
+				break;
+			}
+			case State::MATCH: {
+				if (_length > _size - (_windowOffset + _write)) {
+					throw tref::DecodingError{"Decompression of .tref file failed."};
+				}
+				const std::size_t count{std::min(_length, room)};
+				if (count == 0) {
+					return it - input.data();
+				}
+				std::byte*       dst{_window.data() + _write};
+				const std::byte* src{dst - _matchOffset};
+				if (_matchOffset >= count) {
+					std::memcpy(dst, src, count);
+				}
+				else {
+					// Overlapping matches repeat the last matchOffset bytes, so they must be copied front to back.
+					for (std::size_t i = 0; i < count; ++i) {
+						dst[i] = src[i];
+					}
+				}
+				_write += count;
+				_length -= count;
+				if (_length == 0) {
+					_state = State::TOKEN;
+				}
+				break;
+			}
+			}
+		}
+		return it - input.data();
+	}
+
+	std::span<const std::byte> Lz4Stream::available() const noexcept
+	{
+		return {_window.data() + _read, _write - _read};
+	}
+
+	std::size_t Lz4Stream::offset() const noexcept
+	{
+		return _windowOffset + _read;
+	}
+
+	void Lz4Stream::consume(std::size_t count) noexcept
+	{
+		_read += count;
+	}
+
+	bool Lz4Stream::done() const noexcept
+	{
+		return _windowOffset + _write == _size && (_state == State::TOKEN || _state == State::OFFSET);
+	}
+
+	void Lz4Stream::compact() noexcept
+	{
+		const std::size_t keep{std::max(_write - _read, std::min(_write, LZ4_HISTORY_SIZE))};
+		const std::size_t discard{_write - keep};
+		std::memmove(_window.data(), _window.data() + discard, keep);
+		_windowOffset += discard;
+		_read -= discard;
+		_write -= discard;
+	}
+
+	std::size_t Lz4Stream::decodeSequences(const std::byte*& it, const std::byte* end) noexcept
+	{
+		// Reads a length continued by bytes of 255, failing if it isn't fully contained in the input.
+		const auto readLength{[&](const std::byte*& ptr, std::size_t& length) {
+			for (std::uint8_t byte = 255; byte == 255; length += byte) {
+				if (ptr == end) {
+					return false;
+				}
+				byte = std::to_integer<std::uint8_t>(*ptr++);
+			}
+			return true;
+		}};
+
+		const std::size_t start{_write};
+		while (true) {
+			const std::byte* ptr{it};
+			if (ptr == end) {
+				break;
+			}
+			const std::uint8_t token{std::to_integer<std::uint8_t>(*ptr++)};
+			std::size_t        literals{static_cast<std::size_t>(token >> 4)};
+			if ((literals == 15 && !readLength(ptr, literals)) || static_cast<std::size_t>(end - ptr) <= literals + 2) {
+				break;
+			}
+			const std::byte* literalData{ptr};
+			ptr += literals;
+			const std::size_t offset{std::to_integer<std::size_t>(ptr[0]) | std::to_integer<std::size_t>(ptr[1]) << 8};
+			ptr += 2;
+			std::size_t match{(token & 0xF) + LZ4_MIN_MATCH};
+			if (((token & 0xF) == 15 && !readLength(ptr, match)) ||
+				literals + match > _size - (_windowOffset + _write) ||
+				literals + match + LZ4_COPY_SLACK > _window.size() - _write || offset == 0 ||
+				offset > _windowOffset + _write + literals) {
+				break;
+			}
+
+			// Short copies are done as a single fixed-size copy, which may write past the sequence into the slack.
+			std::byte* dst{_window.data() + _write};
+			if (literals <= LZ4_COPY_SLACK && static_cast<std::size_t>(end - literalData) >= LZ4_COPY_SLACK) {
+				std::memcpy(dst, literalData, LZ4_COPY_SLACK);
+			}
+			else {
+				std::memcpy(dst, literalData, literals);
+			}
+			dst += literals;
+			const std::byte* src{dst - offset};
+			if (offset >= LZ4_COPY_SLACK) {
+				for (std::size_t i = 0; i < match; i += LZ4_COPY_SLACK) {
+					std::memcpy(dst + i, src + i, LZ4_COPY_SLACK);
+				}
+			}
+			else {
+				// Overlapping matches repeat the last offset bytes, so they must be copied front to back.
+				for (std::size_t i = 0; i < match; ++i) {
+					dst[i] = src[i];
+				}
+			}
+			_write += literals + match;
+			it = ptr;
+		}
+		return _write - start;
+	}
+} // namespace tref::detail
\ No newline at end of file
@@ -0,0 +1,165 @@
+#include "common.hpp"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace tref::detail {
+	WorkerPool::WorkerPool(unsigned int threads)
+	{
+		for (unsigned int i = 0; i < threads; ++i) {
+			_threads.emplace_back([this](std::stop_token stop) { run(stop); });
+		}
+	}
+
+	void WorkerPool::post(std::function<void()> task)
+	{
+		{
+			std::lock_guard lock{_mutex};
+			_tasks.push_back(std::move(task));
+		}
+		_available.notify_one();
+	}
+
+	void WorkerPool::run(std::stop_token stop)
+	{
+		while (true) {
+			std::function<void()> task;
+			{
+				std::unique_lock lock{_mutex};
+				if (!_available.wait(lock, stop, [this] { return !_tasks.empty(); })) {
+					return;
+				}
+				task = std::move(_tasks.front());
+				_tasks.pop_front();
+			}
+			task();
+		}
+	}
+
+	WorkerPool& sharedPool()
+	{
+		static WorkerPool pool{std::max(std::thread::hardware_concurrency(), 1U)};
+		return pool;
+	}
+
+	bool isParallel(const tref::DecodeOptions& options) noexcept
+	{
+		return options.executor != nullptr || options.threads > 1;
+	}
+
+	bool isPipelined(const tref::DecodeOptions& options) noexcept
+	{
+		return options.pipelined && !options.cropBitmap;
+	}
+
+	void runConcurrently(tref::Executor* executor, const std::function<void()>& background,
+						 const std::function<void()>& foreground)
+	{
+		// As in parallelFor, the state is shared with the background task in case it's started late.
+		struct State {
+			std::atomic<bool>       claimed{false};
+			bool                    completed{false};
+			std::mutex              mutex;
+			std::condition_variable done;
+			std::exception_ptr      error;
+		};
+		const std::shared_ptr<State> state{std::make_shared<State>()};
+
+		// Runs the background task unless it was already claimed.
+		const auto work{[state, &background] {
+			if (state->claimed.exchange(true)) {
+				return;
+			}
+			try {
+				background();
+			}
+			catch (...) {
+				state->error = std::current_exception();
+			}
+
+			std::lock_guard lock{state->mutex};
+			state->completed = true;
+			state->done.notify_all();
+		}};
+
+		if (executor != nullptr) {
+			executor->execute(work);
+		}
+		else {
+			sharedPool().post(work);
+		}
+
+		std::exception_ptr error;
+		try {
+			foreground();
+		}
+		catch (...) {
+			error = std::current_exception();
+		}
+
+		// If the background task didn't start by the time the foreground task is done, it's run on the calling thread.
+		work();
+		std::unique_lock lock{state->mutex};
+		state->done.wait(lock, [&] { return state->completed; });
+		if (error != nullptr || state->error != nullptr) {
+			std::rethrow_exception(error != nullptr ? error : state->error);
+		}
+	}
+
+	void parallelFor(tref::Executor* executor, unsigned int threads, std::size_t count,
+					 const std::function<void(std::size_t)>& task)
+	{
+		// The state is shared with the workers, as tasks given to an executor or the shared pool may only start after
+		// all work is done. Such late workers never claim an index, so they never touch anything else.
+		struct State {
+			std::atomic<std::size_t> next{0};
+			std::size_t              completed{0};
+			std::mutex               mutex;
+			std::condition_variable  done;
+			std::exception_ptr       error;
+		};
+		const std::shared_ptr<State> state{std::make_shared<State>()};
+
+		// Claims and runs tasks until there are none left.
+		const auto work{[state, count, &task] {
+			for (std::size_t i = state->next++; i < count; i = state->next++) {
+				try {
+					task(i);
+				}
+				catch (...) {
+					std::lock_guard lock{state->mutex};
+					if (state->error == nullptr) {
+						state->error = std::current_exception();
+					}
+				}
+
+				std::lock_guard lock{state->mutex};
+				if (++state->completed == count) {
+					state->done.notify_all();
+				}
+			}
+		}};
+
+		if (executor != nullptr) {
+			const std::size_t workers{
+				std::min<std::size_t>(count, std::max(std::thread::hardware_concurrency(), 2U)) - 1};
+			for (std::size_t i = 0; i < workers; ++i) {
+				executor->execute(work);
+			}
+		}
+		else {
+			for (std::size_t i = 1; i < std::min<std::size_t>(count, threads); ++i) {
+				sharedPool().post(work);
+			}
+		}
+		work();
+
+		std::unique_lock lock{state->mutex};
+		state->done.wait(lock, [&] { return state->completed == count; });
+		if (state->error != nullptr) {
+			std::rethrow_exception(state->error);
+		}
+	}
+} // namespace tref::detail
\ No newline at end of file
@@ -0,0 +1,536 @@
+#include "common.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <string_view>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define TREF_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// Lets a function use an instruction set the rest of the library isn't compiled for. MSVC allows intrinsics anywhere.
+#if defined(__GNUC__) || defined(__clang__)
+#define TREF_TARGET(features) __attribute__((target(features)))
+#else
+#define TREF_TARGET(features)
+#endif
+
+namespace tref::detail {
+	// Converts RGBA pixels to BGRA.
+	void convertToBgra(const std::byte* in, std::byte* out, std::size_t count) noexcept
+	{
+		for (std::size_t i = 0; i < count; ++i) {
+			out[i * 4 + 0] = in[i * 4 + 2];
+			out[i * 4 + 1] = in[i * 4 + 1];
+			out[i * 4 + 2] = in[i * 4 + 0];
+			out[i * 4 + 3] = in[i * 4 + 3];
+		}
+	}
+
+	// Extracts the alpha channel of RGBA pixels.
+	void convertToA8(const std::byte* in, std::byte* out, std::size_t count) noexcept
+	{
+		for (std::size_t i = 0; i < count; ++i) {
+			out[i] = in[i * 4 + 3];
+		}
+	}
+
+	// Premultiplies the color channels of RGBA pixels by alpha.
+	void convertToPremultipliedRgba(const std::byte* in, std::byte* out, std::size_t count) noexcept
+	{
+		for (std::size_t i = 0; i < count; ++i) {
+			const unsigned int a{std::to_integer<unsigned int>(in[i * 4 + 3])};
+			for (int c = 0; c < 3; ++c) {
+				const unsigned int product{std::to_integer<unsigned int>(in[i * 4 + c]) * a + 128};
+				out[i * 4 + c] = static_cast<std::byte>((product + (product >> 8)) >> 8);
+			}
+			out[i * 4 + 3] = in[i * 4 + 3];
+		}
+	}
+
+#ifdef TREF_X86
+	// GCC 12 warns about the placeholder values its AVX-512 intrinsics start from as if they were uninitialized
+	// variables.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+	// The vectorized kernels convert as many pixels as fit in their registers, then leave the rest to the kernels of
+	// the next less capable instruction set.
+
+	TREF_TARGET("sse4.2") void convertToBgraSse42(const std::byte* in, std::byte* out, std::size_t count) noexcept
+	{
+		std::size_t   i{0};
+		const __m128i swizzle{_mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15)};
+		for (; i + 4 <= count; i += 4) {
+			const __m128i px{_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i * 4))};
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i * 4), _mm_shuffle_epi8(px, swizzle));
+		}
+		convertToBgra(in + i * 4, out + i * 4, count - i);
+	}
+
+	TREF_TARGET("avx2") void convertToBgraAvx2(const std::byte* in, std::byte* out, std::size_t count) noexcept
+	{
+		std::size_t   i{0};
+		const __m256i swizzle{_mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15, 2, 1, 0, 3, 6, 5,
+											   4, 7, 10, 9, 8, 11, 14, 13, 12, 15)};
+		for (; i + 8 <= count; i += 8) {
+			const __m256i px{_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i * 4))};
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i * 4), _mm256_shuffle_epi8(px, swizzle));
+		}
+		convertToBgraSse42(in + i * 4, out + i * 4, count - i);
+	}
+
+	TREF_TARGET("avx512f,avx512bw")
+	void convertToBgraAvx512(const std::byte* in, std::byte* out, std::size_t count) noexcept
+	{
+		std::size_t   i{0};
+		const __m512i swizzle{
+			_mm512_broadcast_i32x4(_mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15))};
+		for (; i + 16 <= count; i += 16) {
+			const __m512i px{_mm512_loadu_si512(in + i * 4)};
+			_mm512_storeu_si512(out + i * 4, _mm512_shuffle_epi8(px, swizzle));
+		}
+		convertToBgraAvx2(in + i * 4, out + i * 4, count - i);
+	}
+
+	TREF_TARGET("sse4.2") void convertToA8Sse42(const std::byte* in, std::byte* out, std::size_t count) noexcept
+	{
+		std::size_t i{0};
+		for (; i + 16 <= count; i += 16) {
+			const auto*   src{reinterpret_cast<const __m128i*>(in + i * 4)};
+			const __m128i a{_mm_srli_epi32(_mm_loadu_si128(src + 0), 24)};
+			const __m128i b{_mm_srli_epi32(_mm_loadu_si128(src + 1), 24)};
+			const __m128i c{_mm_srli_epi32(_mm_loadu_si128(src + 2), 24)};
+			const __m128i d{_mm_srli_epi32(_mm_loadu_si128(src + 3), 24)};
+			const __m128i packed{_mm_packus_epi16(_mm_packus_epi32(a, b), _mm_packus_epi32(c, d))};
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), packed);
+		}
+		convertToA8(in + i * 4, out + i, count - i);
+	}
+
+	TREF_TARGET("avx2") void convertToA8Avx2(const std::byte* in, std::byte* out, std::size_t count) noexcept
+	{
+		std::size_t   i{0};
+		const __m256i order{_mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7)};
+		for (; i + 32 <= count; i += 32) {
+			const auto*   src{reinterpret_cast<const __m256i*>(in + i * 4)};
+			const __m256i a{_mm256_srli_epi32(_mm256_loadu_si256(src + 0), 24)};
+			const __m256i b{_mm256_srli_epi32(_mm256_loadu_si256(src + 1), 24)};
+			const __m256i c{_mm256_srli_epi32(_mm256_loadu_si256(src + 2), 24)};
+			const __m256i d{_mm256_srli_epi32(_mm256_loadu_si256(src + 3), 24)};
+			const __m256i packed{_mm256_packus_epi16(_mm256_packus_epi32(a, b), _mm256_packus_epi32(c, d))};
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_permutevar8x32_epi32(packed, order));
+		}
+		convertToA8Sse42(in + i * 4, out + i, count - i);
+	}
+
+	TREF_TARGET("avx512f,avx512bw")
+	void convertToA8Avx512(const std::byte* in, std::byte* out, std::size_t count) noexcept
+	{
+		std::size_t i{0};
+		for (; i + 64 <= count; i += 64) {
+			for (std::size_t j = 0; j < 64; j += 16) {
+				const __m512i px{_mm512_loadu_si512(in + (i + j) * 4)};
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + j),
+								 _mm512_cvtepi32_epi8(_mm512_srli_epi32(px, 24)));
+			}
+		}
+		convertToA8Avx2(in + i * 4, out + i, count - i);
+	}
+
+	// Premultiplies two RGBA pixels unpacked to 16-bit channels.
+	TREF_TARGET("sse4.2") inline __m128i premultiply(__m128i px) noexcept
+	{
+		const __m128i alphaMask{_mm_setr_epi8(6, 7, 6, 7, 6, 7, -1, -1, 14, 15, 14, 15, 14, 15, -1, -1)};
+		const __m128i alpha{_mm_or_si128(_mm_shuffle_epi8(px, alphaMask), _mm_setr_epi16(0, 0, 0, 255, 0, 0, 0, 255))};
+		const __m128i product{_mm_add_epi16(_mm_mullo_epi16(px, alpha), _mm_set1_epi16(128))};
+		return _mm_srli_epi16(_mm_add_epi16(product, _mm_srli_epi16(product, 8)), 8);
+	}
+
+	// Premultiplies four RGBA pixels unpacked to 16-bit channels.
+	TREF_TARGET("avx2") inline __m256i premultiply(__m256i px) noexcept
+	{
+		const __m256i alphaMask{_mm256_setr_epi8(6, 7, 6, 7, 6, 7, -1, -1, 14, 15, 14, 15, 14, 15, -1, -1, 6, 7, 6, 7,
+												 6, 7, -1, -1, 14, 15, 14, 15, 14, 15, -1, -1)};
+		const __m256i alpha{_mm256_or_si256(_mm256_shuffle_epi8(px, alphaMask),
+											_mm256_setr_epi16(0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255))};
+		const __m256i product{_mm256_add_epi16(_mm256_mullo_epi16(px, alpha), _mm256_set1_epi16(128))};
+		return _mm256_srli_epi16(_mm256_add_epi16(product, _mm256_srli_epi16(product, 8)), 8);
+	}
+
+	// Premultiplies eight RGBA pixels unpacked to 16-bit channels.
+	TREF_TARGET("avx512f,avx512bw") inline __m512i premultiply(__m512i px) noexcept
+	{
+		const __m512i alphaMask{
+			_mm512_broadcast_i32x4(_mm_setr_epi8(6, 7, 6, 7, 6, 7, -1, -1, 14, 15, 14, 15, 14, 15, -1, -1))};
+		const __m512i opaque{_mm512_broadcast_i32x4(_mm_setr_epi16(0, 0, 0, 255, 0, 0, 0, 255))};
+		const __m512i alpha{_mm512_or_si512(_mm512_shuffle_epi8(px, alphaMask), opaque)};
+		const __m512i product{_mm512_add_epi16(_mm512_mullo_epi16(px, alpha), _mm512_set1_epi16(128))};
+		return _mm512_srli_epi16(_mm512_add_epi16(product, _mm512_srli_epi16(product, 8)), 8);
+	}
+
+	TREF_TARGET("sse4.2")
+	void convertToPremultipliedRgbaSse42(const std::byte* in, std::byte* out, std::size_t count) noexcept
+	{
+		std::size_t   i{0};
+		const __m128i zero{_mm_setzero_si128()};
+		for (; i + 4 <= count; i += 4) {
+			const __m128i px{_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i * 4))};
+			const __m128i lo{premultiply(_mm_unpacklo_epi8(px, zero))};
+			const __m128i hi{premultiply(_mm_unpackhi_epi8(px, zero))};
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i * 4), _mm_packus_epi16(lo, hi));
+		}
+		convertToPremultipliedRgba(in + i * 4, out + i * 4, count - i);
+	}
+
+	TREF_TARGET("avx2")
+	void convertToPremultipliedRgbaAvx2(const std::byte* in, std::byte* out, std::size_t count) noexcept
+	{
+		std::size_t   i{0};
+		const __m256i zero{_mm256_setzero_si256()};
+		for (; i + 8 <= count; i += 8) {
+			const __m256i px{_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i * 4))};
+			const __m256i lo{premultiply(_mm256_unpacklo_epi8(px, zero))};
+			const __m256i hi{premultiply(_mm256_unpackhi_epi8(px, zero))};
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i * 4), _mm256_packus_epi16(lo, hi));
+		}
+		convertToPremultipliedRgbaSse42(in + i * 4, out + i * 4, count - i);
+	}
+
+	TREF_TARGET("avx512f,avx512bw")
+	void convertToPremultipliedRgbaAvx512(const std::byte* in, std::byte* out, std::size_t count) noexcept
+	{
+		std::size_t   i{0};
+		const __m512i zero{_mm512_setzero_si512()};
+		for (; i + 16 <= count; i += 16) {
+			const __m512i px{_mm512_loadu_si512(in + i * 4)};
+			const __m512i lo{premultiply(_mm512_unpacklo_epi8(px, zero))};
+			const __m512i hi{premultiply(_mm512_unpackhi_epi8(px, zero))};
+			_mm512_storeu_si512(out + i * 4, _mm512_packus_epi16(lo, hi));
+		}
+		convertToPremultipliedRgbaAvx2(in + i * 4, out + i * 4, count - i);
+	}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif
+
+	SimdLevel detectSimdLevel() noexcept
+	{
+#if defined(TREF_X86) && defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		const int maxLeaf{info[0]};
+		__cpuid(info, 1);
+		if ((info[2] & (1 << 20)) == 0) {
+			return SimdLevel::SCALAR;
+		}
+		// AVX state must be enabled by the OS (OSXSAVE and XCR0), on top of being supported by the CPU.
+		const bool osAvx{(info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0};
+		if (!osAvx || maxLeaf < 7) {
+			return SimdLevel::SSE4_2;
+		}
+		const unsigned long long xcr0{_xgetbv(0)};
+		__cpuidex(info, 7, 0);
+		const bool avx2{(info[1] & (1 << 5)) != 0 && (xcr0 & 0x6) == 0x6};
+		const bool avx512{avx2 && (info[1] & (1 << 16)) != 0 && (info[1] & (1 << 30)) != 0 && (xcr0 & 0xE6) == 0xE6};
+		return avx512 ? SimdLevel::AVX512 : avx2 ? SimdLevel::AVX2 : SimdLevel::SSE4_2;
+#elif defined(TREF_X86)
+		__builtin_cpu_init();
+		if (!__builtin_cpu_supports("sse4.2")) {
+			return SimdLevel::SCALAR;
+		}
+		else if (!__builtin_cpu_supports("avx2")) {
+			return SimdLevel::SSE4_2;
+		}
+		else if (!__builtin_cpu_supports("avx512f") || !__builtin_cpu_supports("avx512bw")) {
+			return SimdLevel::AVX2;
+		}
+		return SimdLevel::AVX512;
+#else
+		return SimdLevel::SCALAR;
+#endif
+	}
+
+	SimdLevel selectSimdLevel() noexcept
+	{
+		const SimdLevel supported{detectSimdLevel()};
+#ifdef _MSC_VER
+#pragma warning(suppress : 4996)
+#endif
+		const char* forced{std::getenv("TREF_SIMD")};
+		if (forced == nullptr) {
+			return supported;
+		}
+
+		constexpr std::pair<std::string_view, SimdLevel> NAMES[]{{"scalar", SimdLevel::SCALAR},
+																 {"sse4.2", SimdLevel::SSE4_2},
+																 {"avx2", SimdLevel::AVX2},
+																 {"avx512", SimdLevel::AVX512}};
+		for (const auto& [name, level] : NAMES) {
+			if (name == forced) {
+				return std::min(level, supported);
+			}
+		}
+		return supported;
+	}
+
+	const PixelKernels& pixelKernels(SimdLevel level) noexcept
+	{
+		static constexpr PixelKernels SCALAR{convertToBgra, convertToA8, convertToPremultipliedRgba};
+#ifdef TREF_X86
+		static constexpr PixelKernels SSE4_2{convertToBgraSse42, convertToA8Sse42, convertToPremultipliedRgbaSse42};
+		static constexpr PixelKernels AVX2{convertToBgraAvx2, convertToA8Avx2, convertToPremultipliedRgbaAvx2};
+		static constexpr PixelKernels AVX512{convertToBgraAvx512, convertToA8Avx512, convertToPremultipliedRgbaAvx512};
+		switch (level) {
+		case SimdLevel::SSE4_2:
+			return SSE4_2;
+		case SimdLevel::AVX2:
+			return AVX2;
+		case SimdLevel::AVX512:
+			return AVX512;
+		default:
+			break;
+		}
+#endif
+		return SCALAR;
+	}
+
+	const PixelKernels& pixelKernels() noexcept
+	{
+		static const PixelKernels& kernels{pixelKernels(selectSimdLevel())};
+		return kernels;
+	}
+
+	void convertPixels(tref::PixelFormat format, const std::byte* in, std::byte* out, std::size_t count) noexcept
+	{
+		switch (format) {
+		case tref::PixelFormat::RGBA8:
+			std::memcpy(out, in, count * 4);
+			break;
+		case tref::PixelFormat::BGRA8:
+			pixelKernels().toBgra(in, out, count);
+			break;
+		case tref::PixelFormat::A8:
+			pixelKernels().toA8(in, out, count);
+			break;
+		case tref::PixelFormat::PREMULTIPLIED_RGBA8:
+			pixelKernels().toPremultipliedRgba(in, out, count);
+			break;
+		}
+	}
+
+	PixelWriter::PixelWriter(const tref::BitmapTarget& target, tref::PixelFormat format,
+							 std::pmr::memory_resource* resource) noexcept
+		: _target{&target}
+		, _sink{nullptr}
+		, _batchRows{0}
+		, _format{format}
+		, _storedWidth{0}
+		, _width{0}
+		, _height{0}
+		, _region{}
+		, _cropped{false}
+		, _batch{resource}
+		, _staging{resource}
+		, _pixels{0}
+		, _written{0}
+		, _outStart{0}
+		, _row{0}
+		, _rowDecoded{0}
+	{
+	}
+
+	PixelWriter::PixelWriter(const tref::RowSink& sink, unsigned int batchRows, tref::PixelFormat format,
+							 std::pmr::memory_resource* resource) noexcept
+		: _target{nullptr}
+		, _sink{&sink}
+		, _batchRows{std::max(batchRows, 1U)}
+		, _format{format}
+		, _storedWidth{0}
+		, _width{0}
+		, _height{0}
+		, _region{}
+		, _cropped{false}
+		, _batch{resource}
+		, _staging{resource}
+		, _pixels{0}
+		, _written{0}
+		, _outStart{0}
+		, _row{0}
+		, _rowDecoded{0}
+	{
+	}
+
+	void PixelWriter::begin(unsigned int width, unsigned int height, const tref::Rect& region)
+	{
+		_storedWidth = width;
+		_region      = region;
+		_cropped     = region != tref::Rect{0, 0, width, height};
+		_width       = region.width;
+		_height      = region.height;
+		_pixels      = std::size_t{_width} * _height;
+		_written     = 0;
+		_row         = 0;
+		_rowDecoded  = 0;
+
+		if (_target != nullptr) {
+			_out = (*_target)(_width, _height);
+			if (_out.size() < _pixels * tref::bytesPerPixel(_format)) {
+				throw tref::DecodingError{"Bitmap target buffer is too small."};
+			}
+		}
+		else {
+			_batch.resize(std::size_t{std::min(_batchRows, _height)} * _width * tref::bytesPerPixel(_format));
+			_out = _batch;
+		}
+		if (_cropped) {
+			_staging.resize(std::size_t{_storedWidth} * 4);
+		}
+		else if (_format != tref::PixelFormat::RGBA8) {
+			_staging.resize(std::min(STAGING_PIXELS, _pixels) * 4);
+		}
+		_outStart = 0;
+	}
+
+	bool PixelWriter::decode(QoiDecoder& qoi, const std::byte*& it, const std::byte* end, unsigned int endRow)
+	{
+		if (_cropped) {
+			return decodeCropped(qoi, it, end, endRow);
+		}
+
+		const std::size_t limit{std::size_t{std::min(endRow, _height)} * _width};
+		while (_written < limit) {
+			if (_format == tref::PixelFormat::RGBA8) {
+				const std::size_t count{std::min(space(), limit - _written)};
+				const std::size_t decoded{qoi.decode(it, end, next(), count)};
+				commit(decoded);
+				if (decoded < count) {
+					return false;
+				}
+			}
+			else {
+				const std::size_t count{std::min({space(), limit - _written, STAGING_PIXELS})};
+				const std::size_t decoded{qoi.decode(it, end, _staging.data(), count)};
+				convertPixels(_format, _staging.data(), next(), decoded);
+				commit(decoded);
+				if (decoded < count) {
+					return false;
+				}
+			}
+		}
+		return _written == _pixels;
+	}
+
+	void PixelWriter::fill(const QoiDecoder& qoi)
+	{
+		if (_cropped) {
+			while (_row < _region.y + _region.height) {
+				qoi.fill(_staging.data() + _rowDecoded * 4, _storedWidth - _rowDecoded);
+				writeRow();
+			}
+			return;
+		}
+
+		while (_written < _pixels) {
+			if (_format == tref::PixelFormat::RGBA8) {
+				const std::size_t count{space()};
+				qoi.fill(next(), count);
+				commit(count);
+			}
+			else {
+				const std::size_t count{std::min(space(), STAGING_PIXELS)};
+				qoi.fill(_staging.data(), count);
+				convertPixels(_format, _staging.data(), next(), count);
+				commit(count);
+			}
+		}
+	}
+
+	void PixelWriter::write(const std::byte* pixels, std::size_t count)
+	{
+		while (count > 0) {
+			const std::size_t written{std::min(space(), count)};
+			convertPixels(_format, pixels, next(), written);
+			commit(written);
+			pixels += written * 4;
+			count -= written;
+		}
+	}
+
+	bool PixelWriter::random() const noexcept
+	{
+		return _target != nullptr;
+	}
+
+	void PixelWriter::writeRows(unsigned int row, const std::byte* pixels, unsigned int rows) const noexcept
+	{
+		convertPixels(_format, pixels, _out.data() + std::size_t{row} * _width * tref::bytesPerPixel(_format),
+					  std::size_t{rows} * _width);
+	}
+
+	std::pmr::memory_resource* PixelWriter::resource() const noexcept
+	{
+		return _batch.get_allocator().resource();
+	}
+
+	unsigned int PixelWriter::row() const noexcept
+	{
+		if (_cropped) {
+			return _row;
+		}
+		return _width == 0 ? _height : static_cast<unsigned int>(_written / _width);
+	}
+
+	bool PixelWriter::decodeCropped(QoiDecoder& qoi, const std::byte*& it, const std::byte* end, unsigned int endRow)
+	{
+		const unsigned int bottom{_region.y + _region.height};
+		while (_row < std::min(endRow, bottom)) {
+			_rowDecoded += qoi.decode(it, end, _staging.data() + _rowDecoded * 4, _storedWidth - _rowDecoded);
+			if (_rowDecoded < _storedWidth) {
+				return false;
+			}
+			writeRow();
+		}
+		return _row == bottom;
+	}
+
+	void PixelWriter::writeRow()
+	{
+		if (_row >= _region.y) {
+			convertPixels(_format, _staging.data() + std::size_t{_region.x} * 4, next(), _region.width);
+			commit(_region.width);
+		}
+		++_row;
+		_rowDecoded = 0;
+	}
+
+	std::size_t PixelWriter::space() const noexcept
+	{
+		return std::min(_out.size() / tref::bytesPerPixel(_format) - (_written - _outStart), _pixels - _written);
+	}
+
+	std::byte* PixelWriter::next() const noexcept
+	{
+		return _out.data() + (_written - _outStart) * tref::bytesPerPixel(_format);
+	}
+
+	void PixelWriter::commit(std::size_t count)
+	{
+		_written += count;
+		const std::size_t batchPixels{_batch.size() / tref::bytesPerPixel(_format)};
+		if (_sink != nullptr && (_written - _outStart == batchPixels || _written == _pixels)) {
+			const std::size_t rows{(_written - _outStart) / _width};
+			(*_sink)(tref::RowBatch{_width, _height, static_cast<unsigned int>(_outStart / _width),
+									{_batch.data(), rows * _width * tref::bytesPerPixel(_format)}});
+			_outStart = _written;
+		}
+	}
+} // namespace tref::detail
\ No newline at end of file
@@ -0,0 +1,153 @@
+#include "common.hpp"
+#include <algorithm>
+#include <lz4.h>
+
+namespace tref::detail {
+	// Amount of compressed data fed to the decompressor at once when probing a version 1 file.
+	inline constexpr std::size_t PROBE_CHUNK_SIZE{256};
+
+	std::size_t fileHeaderSize(const std::byte* magic)
+	{
+		const std::string_view str{reinterpret_cast<const char*>(magic), 4};
+		if (str == "TREF") {
+			return FILE_HEADER_V1_BYTES;
+		}
+		else if (str == "TRF2") {
+			return FILE_HEADER_V2_BYTES;
+		}
+		else if (str == "TRF3") {
+			return FILE_HEADER_V3_BYTES;
+		}
+		else {
+			throw tref::DecodingError{"Invalid .tref file header."};
+		}
+	}
+
+	FileHeader readFileHeader(const std::byte*& ptr, const std::byte* end)
+	{
+		if (end - ptr < 4) {
+			throw tref::DecodingError{"Invalid .tref file header."};
+		}
+
+		const std::size_t size{fileHeaderSize(ptr)};
+		FileHeader        header{};
+		ptr += 4;
+		if (size == FILE_HEADER_V1_BYTES) {
+			header.version = 1;
+			header.rawSize = readBinary<std::uint32_t>(ptr, end);
+			return header;
+		}
+
+		header.version    = size == FILE_HEADER_V2_BYTES ? 2 : 3;
+		header.lineSkip   = readBinary<std::int32_t>(ptr, end);
+		header.glyphCount = readBinary<std::uint32_t>(ptr, end);
+		header.width      = readBinary<std::uint32_t>(ptr, end);
+		header.height     = readBinary<std::uint32_t>(ptr, end);
+		header.rawSize    = readBinary<std::uint32_t>(ptr, end);
+		if (header.version == 3) {
+			header.tileWidth      = readBinary<std::uint32_t>(ptr, end);
+			header.tileHeight     = readBinary<std::uint32_t>(ptr, end);
+			header.glyphTableSize = readBinary<std::uint32_t>(ptr, end);
+			if (header.width == 0 || header.height == 0 || header.tileWidth == 0 || header.tileHeight == 0 ||
+				header.tileWidth > header.width || header.tileHeight > header.height ||
+				header.rawSize / GLYPH_ENTRY_SIZE < header.glyphCount ||
+				header.glyphTableSize > LZ4_COMPRESSBOUND(std::uint64_t{header.glyphCount} * GLYPH_ENTRY_SIZE)) {
+				throw tref::DecodingError{"Invalid .tref file header."};
+			}
+			// Every tile is at least an empty QOI image, which bounds the size of the tile table.
+			const TileLayout layout{header};
+			if ((header.rawSize - std::size_t{header.glyphCount} * GLYPH_ENTRY_SIZE) /
+					(QOI_HEADER_BYTES + QOI_END_MARKER_BYTES) <
+				std::size_t{layout.columns} * layout.rows) {
+				throw tref::DecodingError{"Invalid .tref file header."};
+			}
+			return header;
+		}
+		if (header.rawSize < 8 + QOI_HEADER_BYTES + QOI_END_MARKER_BYTES ||
+			(header.rawSize - 8 - QOI_HEADER_BYTES - QOI_END_MARKER_BYTES) / GLYPH_ENTRY_SIZE < header.glyphCount) {
+			throw tref::DecodingError{"Invalid .tref file header."};
+		}
+		return header;
+	}
+
+	void checkFileHeader(const FileHeader& header, std::int32_t lineSkip, std::uint32_t glyphCount,
+						 const qoi_desc& desc)
+	{
+		if (header.version >= 2 && (header.lineSkip != lineSkip || header.glyphCount != glyphCount ||
+									header.width != desc.width || header.height != desc.height)) {
+			throw tref::DecodingError{"Invalid .tref file."};
+		}
+	}
+
+	void checkLimits(const FileHeader& header, const tref::DecodeOptions& options)
+	{
+		if (header.rawSize > options.maxDecompressedSize) {
+			throw tref::LimitError{"Decompressed size of .tref file exceeds the limit."};
+		}
+		if (header.version >= 2) {
+			checkGlyphLimit(header.glyphCount, options);
+			checkBitmapLimit(header.width, header.height, options);
+		}
+	}
+
+	void checkGlyphLimit(std::uint32_t glyphCount, const tref::DecodeOptions& options)
+	{
+		if (glyphCount > options.maxGlyphCount) {
+			throw tref::LimitError{"Glyph count of .tref file exceeds the limit."};
+		}
+	}
+
+	void checkBitmapLimit(std::uint32_t width, std::uint32_t height, const tref::DecodeOptions& options)
+	{
+		if (std::uint64_t{width} * height > options.maxBitmapPixels) {
+			throw tref::LimitError{"Bitmap size of .tref file exceeds the limit."};
+		}
+	}
+} // namespace tref::detail
+
+tref::ProbeInfo tref::probe(std::span<const std::byte> data)
+{
+	const std::byte*         it{data.data()};
+	const std::byte*         end{data.data() + data.size()};
+	const detail::FileHeader header{detail::readFileHeader(it, end)};
+	if (header.version >= 2) {
+		return ProbeInfo{header.version, header.lineSkip, header.glyphCount, header.width, header.height,
+						 static_cast<std::size_t>(end - it), header.rawSize};
+	}
+
+	// Version 1 files only store the metadata in the compressed payload, so just enough of it is decompressed to reach
+	// the QOI header.
+	const std::size_t compressedSize{static_cast<std::size_t>(end - it)};
+	detail::Lz4Stream lz4{header.rawSize};
+
+	// Decompresses small amounts of input until at least count bytes of decompressed data are available.
+	const auto pull{[&](std::size_t count) {
+		while (lz4.available().size() < count) {
+			if (lz4.done() || it == end) {
+				throw DecodingError{"Invalid .tref file."};
+			}
+			it += lz4.feed({it, std::min(static_cast<std::size_t>(end - it), detail::PROBE_CHUNK_SIZE)});
+		}
+		return lz4.available();
+	}};
+
+	std::span<const std::byte> payload{pull(8)};
+	const std::byte*           pit{payload.data()};
+	const std::int32_t         lineSkip{detail::readBinary<std::int32_t>(pit, payload.data() + payload.size())};
+	const std::uint32_t        count{detail::readBinary<std::uint32_t>(pit, payload.data() + payload.size())};
+	lz4.consume(8);
+	if ((header.rawSize - 8) / detail::GLYPH_ENTRY_SIZE < count) {
+		throw DecodingError{"Invalid .tref file."};
+	}
+
+	for (std::size_t skip = std::size_t{count} * detail::GLYPH_ENTRY_SIZE; skip > 0;) {
+		const std::size_t skipped{std::min(skip, pull(1).size())};
+		lz4.consume(skipped);
+		skip -= skipped;
+	}
+
+	payload = pull(detail::QOI_HEADER_BYTES);
+	pit     = payload.data();
+	const qoi_desc desc{detail::readQoiHeader(pit, payload.data() + payload.size())};
+	return ProbeInfo{1, lineSkip, count, desc.width, desc.height, compressedSize, header.rawSize};
+}
\ No newline at end of file
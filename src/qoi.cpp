@@ -0,0 +1,320 @@
+#include "common.hpp"
+#include <algorithm>
+
+namespace tref::detail {
+	// QOI chunk tags.
+	inline constexpr std::uint8_t OP_INDEX{0x00};
+	inline constexpr std::uint8_t OP_DIFF{0x40};
+	inline constexpr std::uint8_t OP_LUMA{0x80};
+	inline constexpr std::uint8_t OP_RUN{0xc0};
+	inline constexpr std::uint8_t OP_RGB{0xfe};
+	inline constexpr std::uint8_t OP_RGBA{0xff};
+	inline constexpr std::uint8_t OP_MASK{0xc0};
+
+	// Size of the largest QOI chunk (QOI_OP_RGBA).
+	inline constexpr std::size_t MAX_CHUNK_BYTES{5};
+
+	// Number of pixels written at once when decoding a run if the output has room for them, enough for the longest run.
+	inline constexpr std::size_t WIDE_RUN_PIXELS{64};
+
+	// QOI header magic ("qoif").
+	inline constexpr std::uint32_t MAGIC{'q' << 24 | 'o' << 16 | 'i' << 8 | 'f'};
+
+	// Maximum number of pixels in a QOI image.
+	inline constexpr unsigned int PIXELS_MAX{400000000};
+
+	// Reads a big-endian 32-bit integer.
+	std::uint32_t readBigEndian(const std::byte* ptr) noexcept
+	{
+		return std::to_integer<std::uint32_t>(ptr[0]) << 24 | std::to_integer<std::uint32_t>(ptr[1]) << 16 |
+			   std::to_integer<std::uint32_t>(ptr[2]) << 8 | std::to_integer<std::uint32_t>(ptr[3]);
+	}
+
+	std::pair<tref::Codepoint, tref::Glyph> readGlyphEntry(const std::byte*& ptr, const std::byte* end)
+	{
+		const tref::Codepoint cp{readBinary<tref::Codepoint>(ptr, end)};
+		return {cp, readBinary<tref::Glyph>(ptr, end)};
+	}
+
+	qoi_desc readQoiHeader(const std::byte*& ptr, const std::byte* end)
+	{
+		if (static_cast<std::size_t>(end - ptr) < QOI_HEADER_BYTES) {
+			throw tref::DecodingError{"Failed to decode .tref file image data."};
+		}
+
+		const std::uint32_t magic{readBigEndian(ptr)};
+		qoi_desc            desc;
+		desc.width      = readBigEndian(ptr + 4);
+		desc.height     = readBigEndian(ptr + 8);
+		desc.channels   = std::to_integer<unsigned char>(ptr[12]);
+		desc.colorspace = std::to_integer<unsigned char>(ptr[13]);
+		ptr += QOI_HEADER_BYTES;
+
+		if (magic != MAGIC || desc.width == 0 || desc.height == 0 || desc.channels < 3 || desc.channels > 4 ||
+			desc.colorspace > 1 || desc.height >= PIXELS_MAX / desc.width) {
+			throw tref::DecodingError{"Failed to decode .tref file image data."};
+		}
+		return desc;
+	}
+
+	// Writes a big-endian 32-bit integer.
+	std::byte* writeBigEndian(std::byte* ptr, std::uint32_t value) noexcept
+	{
+		for (const int shift : {24, 16, 8, 0}) {
+			*ptr++ = static_cast<std::byte>(value >> shift);
+		}
+		return ptr;
+	}
+
+	std::size_t maxQoiSize(unsigned int width, unsigned int height)
+	{
+		if (width == 0 || height == 0 || height >= PIXELS_MAX / width) {
+			throw tref::EncodingError{"Failed to encode .tref file image data."};
+		}
+		return std::size_t{width} * height * 5 + QOI_HEADER_BYTES + QOI_END_MARKER_BYTES;
+	}
+
+	std::size_t encodeQoi(const std::byte* pixels, unsigned int width, unsigned int height, std::size_t stride,
+						  std::byte* out) noexcept
+	{
+		struct Rgba {
+			std::uint8_t r, g, b, a;
+
+			bool operator==(const Rgba&) const = default;
+		};
+
+		std::byte* it{writeBigEndian(out, MAGIC)};
+		it    = writeBigEndian(it, width);
+		it    = writeBigEndian(it, height);
+		*it++ = std::byte{4};
+		*it++ = std::byte{QOI_SRGB};
+
+		const auto op{[&](unsigned int byte) { *it++ = static_cast<std::byte>(byte); }};
+		const auto channels{[&](const Rgba& px, std::size_t count) {
+			std::memcpy(it, &px, count);
+			it += count;
+		}};
+
+		std::array<Rgba, 64> index{};
+		Rgba                 previous{0, 0, 0, 255};
+		unsigned int         run{0};
+		for (unsigned int y = 0; y < height; ++y) {
+			const std::byte* row{pixels + y * stride};
+			for (unsigned int x = 0; x < width; ++x) {
+				Rgba px;
+				std::memcpy(&px, row + std::size_t{x} * 4, 4);
+				if (px == previous) {
+					// Runs are cut at 62 pixels, as longer ones would be mistaken for RGB and RGBA chunks.
+					if (++run == 62) {
+						op(OP_RUN | (run - 1));
+						run = 0;
+					}
+					continue;
+				}
+
+				if (run > 0) {
+					op(OP_RUN | (run - 1));
+					run = 0;
+				}
+				const unsigned int hash{(px.r * 3u + px.g * 5u + px.b * 7u + px.a * 11u) % 64};
+				if (index[hash] == px) {
+					op(OP_INDEX | hash);
+				}
+				else {
+					index[hash] = px;
+
+					const auto vr{static_cast<std::int8_t>(px.r - previous.r)};
+					const auto vg{static_cast<std::int8_t>(px.g - previous.g)};
+					const auto vb{static_cast<std::int8_t>(px.b - previous.b)};
+					const int  vgr{static_cast<std::int8_t>(vr - vg)};
+					const int  vgb{static_cast<std::int8_t>(vb - vg)};
+					if (px.a != previous.a) {
+						op(OP_RGBA);
+						channels(px, 4);
+					}
+					else if (vr >= -2 && vr <= 1 && vg >= -2 && vg <= 1 && vb >= -2 && vb <= 1) {
+						op(OP_DIFF | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2));
+					}
+					else if (vgr >= -8 && vgr <= 7 && vg >= -32 && vg <= 31 && vgb >= -8 && vgb <= 7) {
+						op(OP_LUMA | (vg + 32));
+						op((vgr + 8) << 4 | (vgb + 8));
+					}
+					else {
+						op(OP_RGB);
+						channels(px, 3);
+					}
+				}
+				previous = px;
+			}
+		}
+		if (run > 0) {
+			op(OP_RUN | (run - 1));
+		}
+
+		constexpr std::uint8_t END_MARKER[QOI_END_MARKER_BYTES]{0, 0, 0, 0, 0, 0, 0, 1};
+		std::memcpy(it, END_MARKER, QOI_END_MARKER_BYTES);
+		return it + QOI_END_MARKER_BYTES - out;
+	}
+
+	// Fills pixels with a value stored as its 4 bytes, writing two pixels at a time.
+	void fillPixels(std::byte* out, std::uint32_t px, std::size_t count) noexcept
+	{
+		const std::uint64_t pair{std::uint64_t{px} << 32 | px};
+		std::size_t         i{0};
+		for (; i + 2 <= count; i += 2) {
+			std::memcpy(out + i * 4, &pair, 8);
+		}
+		if (i < count) {
+			std::memcpy(out + i * 4, &px, 4);
+		}
+	}
+
+	// Gets the size of the chunk starting with a given byte.
+	std::size_t chunkSize(std::uint8_t b1) noexcept
+	{
+		if (b1 == OP_RGBA) {
+			return 5;
+		}
+		if (b1 == OP_RGB) {
+			return 4;
+		}
+		return (b1 & OP_MASK) == OP_LUMA ? 2 : 1;
+	}
+
+	std::uint32_t QoiDecoder::Rgba::value() const noexcept
+	{
+		std::uint32_t value;
+		std::memcpy(&value, this, 4);
+		return value;
+	}
+
+	unsigned int QoiDecoder::Rgba::hash() const noexcept
+	{
+		return (r * 3 + g * 5 + b * 7 + a * 11) % 64;
+	}
+
+	void QoiDecoder::Rgba::write(std::byte* out) const noexcept
+	{
+		std::memcpy(out, this, 4);
+	}
+
+	QoiDecoder::QoiDecoder() noexcept
+		: _index{}, _px{0, 0, 0, 255}, _run{0}
+	{
+	}
+
+	std::size_t QoiDecoder::decode(const std::byte*& it, const std::byte* end, std::byte* out,
+								   std::size_t count) noexcept
+	{
+		std::size_t written{std::min(_run, count)};
+		fill(out, written);
+		_run -= written;
+		if (_run > 0) {
+			return written;
+		}
+
+		// The state is copied to locals so that it can stay in registers: writes to out could otherwise alias it.
+		std::array<Rgba, 64> index{_index};
+		Rgba                 px{_px};
+		std::size_t          run{0};
+		const auto*          bytes{reinterpret_cast<const std::uint8_t*>(it)};
+		const auto* const    bytesEnd{reinterpret_cast<const std::uint8_t*>(end)};
+
+		// Away from the end of the input and output, any chunk and any run fit, so they aren't checked for each chunk.
+		// The chunks are tested for in order of frequency in font atlases: index lookups and RGBA chunks, runs, then
+		// the others.
+		while (count - written >= WIDE_RUN_PIXELS && static_cast<std::size_t>(bytesEnd - bytes) >= MAX_CHUNK_BYTES) {
+			const std::uint8_t b1{*bytes++};
+			if (b1 < OP_DIFF || b1 == OP_RGBA) {
+				// Index lookups and RGBA chunks alternate unpredictably along antialiased edges, so they are decoded
+				// without branching on which one it is. The bytes of an RGBA chunk are always there to be loaded.
+				const bool rgba{b1 == OP_RGBA};
+				Rgba       loaded;
+				std::memcpy(&loaded, bytes, 4);
+				px = rgba ? loaded : index[b1 & 0x3f];
+				bytes += rgba ? 4 : 0;
+				index[px.hash()] = px;
+				px.write(out + written * 4);
+				++written;
+			}
+			else if (b1 >= OP_RUN && b1 < OP_RGB) {
+				// The pixel is already in the index, unless the image starts with a run.
+				index[px.hash()] = px;
+				// Writing a fixed number of pixels lets the fill be unrolled into wide stores. The pixels past the end
+				// of the run are overwritten by the following chunks.
+				fillPixels(out + written * 4, px.value(), WIDE_RUN_PIXELS);
+				written += (b1 & 0x3f) + 1;
+			}
+			else {
+				px = applyChunk(px, b1, bytes);
+				index[px.hash()] = px;
+				px.write(out + written * 4);
+				++written;
+			}
+		}
+
+		// Near the end of the input, only chunks that are fully contained in it are decoded, and runs are cut at the
+		// end of the output.
+		while (written < count && bytes != bytesEnd &&
+			   chunkSize(*bytes) <= static_cast<std::size_t>(bytesEnd - bytes)) {
+			const std::uint8_t b1{*bytes++};
+			if (b1 < OP_DIFF) {
+				px = index[b1];
+			}
+			else if (b1 >= OP_RUN && b1 < OP_RGB) {
+				run = (b1 & 0x3f) + 1;
+			}
+			else {
+				px = applyChunk(px, b1, bytes);
+			}
+			index[px.hash()] = px;
+
+			if (run == 0) {
+				px.write(out + written * 4);
+				++written;
+			}
+			else {
+				const std::size_t filled{std::min(run, count - written)};
+				fillPixels(out + written * 4, px.value(), filled);
+				written += filled;
+				run -= filled;
+			}
+		}
+
+		it     = reinterpret_cast<const std::byte*>(bytes);
+		_index = index;
+		_px    = px;
+		_run   = run;
+		return written;
+	}
+
+	QoiDecoder::Rgba QoiDecoder::applyChunk(Rgba px, std::uint8_t b1, const std::uint8_t*& bytes) noexcept
+	{
+		if (b1 == OP_RGBA) {
+			px = {bytes[0], bytes[1], bytes[2], bytes[3]};
+			bytes += 4;
+		}
+		else if (b1 == OP_RGB) {
+			px = {bytes[0], bytes[1], bytes[2], px.a};
+			bytes += 3;
+		}
+		else if ((b1 & OP_MASK) == OP_DIFF) {
+			px.r += ((b1 >> 4) & 0x03) - 2;
+			px.g += ((b1 >> 2) & 0x03) - 2;
+			px.b += (b1 & 0x03) - 2;
+		}
+		else {
+			const int b2{*bytes++};
+			const int vg{(b1 & 0x3f) - 32};
+			px.r += vg - 8 + ((b2 >> 4) & 0x0f);
+			px.g += vg;
+			px.b += vg - 8 + (b2 & 0x0f);
+		}
+		return px;
+	}
+
+	void QoiDecoder::fill(std::byte* out, std::size_t count) const noexcept
+	{
+		fillPixels(out, _px.value(), count);
+	}
+} // namespace tref::detail
\ No newline at end of file
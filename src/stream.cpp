@@ -0,0 +1,222 @@
+#include "common.hpp"
+#include <algorithm>
+
+namespace tref::detail {
+	// Amount of memory first allocated for data read into a buffer, which then grows with the data actually read.
+	inline constexpr std::size_t MIN_READ_BUFFER_SIZE{64 * 1024};
+
+	// Decodes a tref file read in chunks from a callback, writing the bitmap through a pixel writer.
+	tref::DecodingInfo decodeStream(const tref::StreamDecoder::ReadCallback& readChunk, std::size_t chunkSize,
+									PixelWriter& writer, const tref::DecodeOptions& options)
+	{
+		if (options.stats != nullptr) {
+			*options.stats = {};
+		}
+
+		std::pmr::vector<std::byte> input(chunkSize, writer.resource());
+		std::span<const std::byte>  pending;
+		std::size_t                 fileSize{0};
+
+		// Reads the next chunk of input once the previous one was fully consumed.
+		const auto read{[&] {
+			if (pending.empty()) {
+				checkStop(options);
+				pending = {input.data(), readChunk(input)};
+				if (pending.empty()) {
+					throw tref::DecodingError{"Unexpected end of .tref file."};
+				}
+				fileSize += pending.size();
+			}
+		}};
+
+		// Reads exactly count bytes of input into out, or skips them if out is null.
+		const auto readExact{[&](std::byte* out, std::size_t count) {
+			for (std::size_t size = 0; size < count;) {
+				read();
+				const std::size_t copied{std::min(count - size, pending.size())};
+				if (out != nullptr) {
+					std::memcpy(out + size, pending.data(), copied);
+				}
+				pending = pending.subspan(copied);
+				size += copied;
+			}
+		}};
+
+		// Reads exactly count bytes of input into a buffer. The buffer is grown as the data arrives rather than sized
+		// up front, so sizes taken from a corrupt file can't allocate much more memory than the file actually has.
+		const auto readBuffer{[&](std::pmr::vector<std::byte>& buffer, std::size_t count) {
+			for (std::size_t size = 0; size < count;) {
+				const std::size_t step{std::min(count - size, std::max(size, MIN_READ_BUFFER_SIZE))};
+				if (buffer.size() < size + step) {
+					buffer.resize(size + step);
+				}
+				readExact(buffer.data() + size, step);
+				size += step;
+			}
+			return std::span<const std::byte>{buffer.data(), count};
+		}};
+
+		FileHeader header;
+		{
+			const StageTimer                            timer{options.trace, HEADER_STAGE, nullptr};
+			std::array<std::byte, FILE_HEADER_V3_BYTES> headerData;
+			readExact(headerData.data(), 4);
+			const std::size_t headerSize{fileHeaderSize(headerData.data())};
+			readExact(headerData.data() + 4, headerSize - 4);
+			const std::byte* it{headerData.data()};
+			header = readFileHeader(it, headerData.data() + headerSize);
+			checkLimits(header, options);
+		}
+
+		if (header.version == 3) {
+			TileLayout                  layout{header};
+			std::pmr::vector<std::byte> buffer{writer.resource()};
+			const std::size_t           tableSize{std::size_t{layout.columns} * layout.rows * TILE_ENTRY_SIZE};
+			std::span<const std::byte>  data{readBuffer(buffer, tableSize)};
+			const std::byte*            it{data.data()};
+			readTileTable(layout, it, data.data() + data.size());
+
+			data = readBuffer(buffer, header.glyphTableSize);
+			std::pmr::vector<std::byte> scratch{writer.resource()};
+			tref::GlyphMap              glyphs{memoryResource(options)};
+			{
+				const StageTimer timer{options, GLYPH_TABLE_STAGE, &tref::DecodeStats::glyphTime};
+				decodeGlyphTable(header, data, scratch, options, glyphs);
+			}
+
+			// Tiles are stored in order, so the ones outside of the output region are simply skipped over.
+			const tref::Rect region{outputRegion(glyphs, qoi_desc{header.width, header.height, 4, QOI_SRGB}, options)};
+			std::size_t      position{0};
+			decodeTiles(layout, region, writer, [&](std::size_t index) {
+				readExact(nullptr, layout.offsets[index] - position);
+				position = layout.offsets[index + 1];
+				return readBuffer(buffer, layout.offsets[index + 1] - layout.offsets[index]);
+			}, options.stats, options.trace);
+
+			tref::DecodingInfo info{header.lineSkip, std::move(glyphs), region.width, region.height};
+			recordStats(options, fileSize, header.rawSize, info);
+			return info;
+		}
+
+		const std::uint32_t rawSize{header.rawSize};
+		Lz4Stream           lz4{rawSize, writer.resource()};
+
+		// Decompresses the pending input into the window.
+		const auto feed{[&] {
+			const StageTimer timer{options, LZ4_DECOMPRESS_STAGE, &tref::DecodeStats::lz4Time};
+			pending = pending.subspan(lz4.feed(pending));
+		}};
+
+		// Decompresses input until at least count bytes of decompressed data are available.
+		const auto pull{[&](std::size_t count) {
+			while (lz4.available().size() < count) {
+				if (lz4.done()) {
+					throw tref::DecodingError{"Invalid .tref file."};
+				}
+				read();
+				feed();
+			}
+			return lz4.available();
+		}};
+
+		std::span<const std::byte> data{pull(8)};
+		const std::byte*           it{data.data()};
+		const std::int32_t  lineSkip{readBinary<std::int32_t>(it, data.data() + data.size())};
+		const std::uint32_t count{readBinary<std::uint32_t>(it, data.data() + data.size())};
+		lz4.consume(8);
+		if ((rawSize - 8) / GLYPH_ENTRY_SIZE < count) {
+			throw tref::DecodingError{"Invalid .tref file."};
+		}
+		checkGlyphLimit(count, options);
+
+		// Space for the glyphs is reserved as their entries are decompressed, for the same reason buffers are grown
+		// as data is read.
+		tref::GlyphMap glyphs{memoryResource(options)};
+		std::size_t    reserved{0};
+		for (std::uint32_t i = 0; i < count;) {
+			data = pull(GLYPH_ENTRY_SIZE);
+			it   = data.data();
+			const StageTimer  timer{options, GLYPH_TABLE_STAGE, &tref::DecodeStats::glyphTime};
+			const std::size_t needed{std::min<std::size_t>(count, i + data.size() / GLYPH_ENTRY_SIZE)};
+			if (!filtersGlyphs(options) && needed > reserved) {
+				reserved = std::min<std::size_t>(count, std::max(needed, 2 * reserved));
+				glyphs.reserve(reserved);
+			}
+			for (; i < count && data.data() + data.size() - it >= static_cast<std::ptrdiff_t>(GLYPH_ENTRY_SIZE); ++i) {
+				addGlyph(glyphs, readGlyphEntry(it, data.data() + data.size()), options);
+			}
+			lz4.consume(it - data.data());
+		}
+
+		data = pull(QOI_HEADER_BYTES);
+		it   = data.data();
+		const qoi_desc desc{readQoiHeader(it, data.data() + data.size())};
+		lz4.consume(QOI_HEADER_BYTES);
+		checkFileHeader(header, lineSkip, count, desc);
+		checkBitmapLimit(desc.width, desc.height, options);
+		if (rawSize - lz4.offset() < QOI_END_MARKER_BYTES) {
+			throw tref::DecodingError{"Failed to decode .tref file image data."};
+		}
+
+		const tref::Rect region{outputRegion(glyphs, desc, options)};
+		writer.begin(desc.width, desc.height, region);
+		const std::size_t chunksEnd{rawSize - QOI_END_MARKER_BYTES};
+		QoiDecoder        qoi;
+		while (true) {
+			{
+				const StageTimer timer{options, QOI_DECODE_STAGE, &tref::DecodeStats::qoiTime};
+				data = lz4.available().first(std::min(lz4.available().size(), chunksEnd - lz4.offset()));
+				it   = data.data();
+				const bool complete{writer.decode(qoi, it, data.data() + data.size())};
+				lz4.consume(it - data.data());
+				if (complete) {
+					break;
+				}
+				else if (lz4.offset() + lz4.available().size() >= chunksEnd) {
+					writer.fill(qoi);
+					break;
+				}
+			}
+			read();
+			feed();
+		}
+
+		tref::DecodingInfo info{lineSkip, std::move(glyphs), region.width, region.height};
+		recordStats(options, fileSize, rawSize, info);
+		return info;
+	}
+} // namespace tref::detail
+
+tref::StreamDecoder::StreamDecoder(std::istream& is, std::size_t chunkSize)
+	: StreamDecoder{[&is](std::span<std::byte> buffer) {
+						is.read(reinterpret_cast<char*>(buffer.data()), buffer.size());
+						return static_cast<std::size_t>(is.gcount());
+					},
+					chunkSize}
+{
+}
+
+tref::StreamDecoder::StreamDecoder(ReadCallback read, std::size_t chunkSize)
+	: _read{std::move(read)}, _chunkSize{std::max(chunkSize, std::size_t{1})}
+{
+}
+
+tref::DecodingResult tref::StreamDecoder::decode(const DecodeOptions& options)
+{
+	return detail::decodeToNewBitmap(options, [&](const BitmapTarget& target) { return decode(target, options); });
+}
+
+tref::DecodingInfo tref::StreamDecoder::decode(const BitmapTarget& target, const DecodeOptions& options)
+{
+	detail::ScratchResource resource{options};
+	detail::PixelWriter     writer{target, options.outputFormat, resource.get()};
+	return detail::decodeStream(_read, _chunkSize, writer, options);
+}
+
+tref::DecodingInfo tref::StreamDecoder::decode(const RowSink& sink, unsigned int batchRows,
+											   const DecodeOptions& options)
+{
+	detail::ScratchResource resource{options};
+	detail::PixelWriter     writer{sink, batchRows, options.outputFormat, resource.get()};
+	return detail::decodeStream(_read, _chunkSize, writer, options);
+}
\ No newline at end of file
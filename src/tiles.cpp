@@ -0,0 +1,362 @@
+#include "common.hpp"
+#include <algorithm>
+#include <lz4.h>
+#include <mutex>
+#include <ranges>
+
+namespace tref::detail {
+	// Decodes a compressed tile into RGBA pixels, reporting its stages to the trace sink and adding their time to the
+	// given totals unless they are null.
+	void decodeTile(std::span<const std::byte> data, std::size_t rawSize, const tref::Rect& rect,
+					std::pmr::vector<std::byte>& scratch, std::byte* out, tref::TraceSink* trace,
+					std::chrono::nanoseconds* lz4Time, std::chrono::nanoseconds* qoiTime)
+	{
+		if (data.size() < rawSize) {
+			const StageTimer timer{trace, LZ4_DECOMPRESS_STAGE, lz4Time};
+			if (rawSize / LZ4_MAX_RATIO > data.size()) {
+				throw tref::DecodingError{"Invalid .tref file."};
+			}
+			scratch.resize(rawSize);
+			const int reportedSize{LZ4_decompress_safe(reinterpret_cast<const char*>(data.data()),
+													   reinterpret_cast<char*>(scratch.data()), data.size(), rawSize)};
+			if (static_cast<std::size_t>(reportedSize) != rawSize) {
+				throw tref::DecodingError{"Decompression of .tref file failed."};
+			}
+			data = scratch;
+		}
+
+		const std::byte* it{data.data()};
+		const qoi_desc   desc{readQoiHeader(it, data.data() + data.size())};
+		if (desc.width != rect.width || desc.height != rect.height ||
+			static_cast<std::size_t>(data.data() + data.size() - it) < QOI_END_MARKER_BYTES) {
+			throw tref::DecodingError{"Failed to decode .tref file image data."};
+		}
+
+		const StageTimer  timer{trace, QOI_DECODE_STAGE, qoiTime};
+		const std::size_t pixels{std::size_t{rect.width} * rect.height};
+		QoiDecoder        qoi;
+		const std::size_t decoded{qoi.decode(it, data.data() + data.size() - QOI_END_MARKER_BYTES, out, pixels)};
+		qoi.fill(out + decoded * 4, pixels - decoded);
+	}
+
+	TileLayout::TileLayout(const FileHeader& header)
+		: width{header.width}
+		, height{header.height}
+		, tileWidth{header.tileWidth}
+		, tileHeight{header.tileHeight}
+		, columns{(header.width - 1) / header.tileWidth + 1}
+		, rows{(header.height - 1) / header.tileHeight + 1}
+		, rawSize{header.rawSize - std::size_t{header.glyphCount} * GLYPH_ENTRY_SIZE}
+	{
+	}
+
+	tref::Rect TileLayout::tileRect(std::size_t index) const noexcept
+	{
+		const unsigned int x{static_cast<unsigned int>(index % columns) * tileWidth};
+		const unsigned int y{static_cast<unsigned int>(index / columns) * tileHeight};
+		return tref::Rect{x, y, std::min(tileWidth, width - x), std::min(tileHeight, height - y)};
+	}
+
+	void readTileTable(TileLayout& layout, const std::byte*& ptr, const std::byte* end)
+	{
+		const std::size_t count{std::size_t{layout.columns} * layout.rows};
+		if (static_cast<std::size_t>(end - ptr) / TILE_ENTRY_SIZE < count) {
+			throw tref::DecodingError{"Invalid .tref file."};
+		}
+
+		layout.offsets.resize(count + 1);
+		layout.rawSizes.resize(count);
+		layout.offsets[0] = 0;
+		std::size_t rawSize{0};
+		for (std::size_t i = 0; i < count; ++i) {
+			const std::uint32_t size{readBinary<std::uint32_t>(ptr, end)};
+			layout.rawSizes[i]    = readBinary<std::uint32_t>(ptr, end);
+			layout.offsets[i + 1] = layout.offsets[i] + size;
+			rawSize += layout.rawSizes[i];
+			// The tiles must fit in the decompressed size given by the preamble, which bounds how much is allocated for
+			// any of them.
+			if (size > layout.rawSizes[i] || layout.rawSizes[i] < QOI_HEADER_BYTES + QOI_END_MARKER_BYTES ||
+				rawSize > layout.rawSize) {
+				throw tref::DecodingError{"Invalid .tref file."};
+			}
+		}
+	}
+
+	// Glyph value marking the nodes of a reused glyph map whose codepoint wasn't found in the new glyph table.
+	inline constexpr tref::Glyph STALE_GLYPH{UINT16_MAX, UINT16_MAX, UINT16_MAX, UINT16_MAX, -1, -1, -1};
+
+	// Reserves space for a number of glyphs in a glyph map, without shrinking its buckets if it already has enough.
+	void reserveGlyphs(tref::GlyphMap& glyphs, std::size_t count)
+	{
+		if (count > glyphs.bucket_count() * glyphs.max_load_factor()) {
+			glyphs.reserve(count);
+		}
+	}
+
+	// Replaces the contents of a non-empty glyph map with the selected entries of a glyph table, giving the nodes of
+	// codepoints that are gone to new codepoints instead of freeing them and allocating new ones. Returns false,
+	// leaving the map in an unspecified state, if an entry can't be told apart from STALE_GLYPH.
+	bool reuseGlyphNodes(tref::GlyphMap& glyphs, const std::byte* table, std::uint32_t count,
+						 const tref::DecodeOptions& options)
+	{
+		const std::byte* const end{table + std::size_t{count} * GLYPH_ENTRY_SIZE};
+		for (auto& [cp, glyph] : glyphs) {
+			glyph = STALE_GLYPH;
+		}
+
+		// The entries are visited backwards so that the first of duplicate entries wins, as with emplace().
+		std::size_t selected{0};
+		for (const std::byte* entry{end}; entry != table;) {
+			entry -= GLYPH_ENTRY_SIZE;
+			const std::byte* it{entry};
+			const auto [cp, glyph]{readGlyphEntry(it, end)};
+			if (selectsGlyph(cp, options)) {
+				if (glyph == STALE_GLYPH) {
+					return false;
+				}
+				else if (const auto node{glyphs.find(cp)}; node != glyphs.end()) {
+					node->second = glyph;
+				}
+				++selected;
+			}
+		}
+
+		// Reserving up front ensures no rehash happens while the map is iterated below.
+		reserveGlyphs(glyphs, selected);
+		auto stale{glyphs.begin()};
+		for (const std::byte* it{table}; it != end;) {
+			const auto [cp, glyph]{readGlyphEntry(it, end)};
+			if (!selectsGlyph(cp, options) || glyphs.contains(cp)) {
+				continue;
+			}
+
+			while (stale != glyphs.end() && stale->second != STALE_GLYPH) {
+				++stale;
+			}
+			if (stale != glyphs.end()) {
+				auto node{glyphs.extract(stale++)};
+				node.key()    = cp;
+				node.mapped() = glyph;
+				glyphs.insert(std::move(node));
+			}
+			else {
+				glyphs.emplace(cp, glyph);
+			}
+		}
+		std::erase_if(glyphs, [](const auto& entry) { return entry.second == STALE_GLYPH; });
+		return true;
+	}
+
+	// Gets the codepoint of an entry of a glyph table.
+	tref::Codepoint entryCodepoint(const std::byte* table, std::size_t index) noexcept
+	{
+		tref::Codepoint cp;
+		std::memcpy(&cp, table + index * GLYPH_ENTRY_SIZE, sizeof(cp));
+		return cp;
+	}
+
+	// Gets whether the entries of a glyph table are sorted by codepoint without duplicates, as written by encode().
+	bool isSortedGlyphTable(const std::byte* table, std::uint32_t count) noexcept
+	{
+		for (std::uint32_t i = 1; i < count; ++i) {
+			if (entryCodepoint(table, i - 1) >= entryCodepoint(table, i)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Adds the glyphs within codepoint ranges from a sorted glyph table, finding the entries of each range by binary
+	// search instead of testing every entry.
+	void addGlyphRanges(tref::GlyphMap& glyphs, const std::byte* table, std::uint32_t count,
+						std::span<const tref::CodepointRange> ranges)
+	{
+		const auto indices{std::views::iota(std::uint32_t{0}, count)};
+		const auto codepoint{[&](std::uint32_t index) { return entryCodepoint(table, index); }};
+		const auto entries{[&](const tref::CodepointRange& range) {
+			const auto first{std::ranges::lower_bound(indices, range.first, {}, codepoint)};
+			const auto last{std::ranges::upper_bound(first, indices.end(), range.last, {}, codepoint)};
+			return std::pair{static_cast<std::uint32_t>(first - indices.begin()),
+							 static_cast<std::uint32_t>(last - indices.begin())};
+		}};
+
+		std::size_t selected{0};
+		for (const tref::CodepointRange& range : ranges) {
+			const auto [first, last]{entries(range)};
+			selected += last - first;
+		}
+		reserveGlyphs(glyphs, std::min<std::size_t>(selected, count));
+
+		const std::byte* const end{table + std::size_t{count} * GLYPH_ENTRY_SIZE};
+		for (const tref::CodepointRange& range : ranges) {
+			const auto [first, last]{entries(range)};
+			const std::byte* it{table + std::size_t{first} * GLYPH_ENTRY_SIZE};
+			for (std::uint32_t i = first; i < last; ++i) {
+				glyphs.emplace(readGlyphEntry(it, end));
+			}
+		}
+	}
+
+	void readGlyphTable(const std::byte*& ptr, const std::byte* end, std::uint32_t count,
+						const tref::DecodeOptions& options, tref::GlyphMap& glyphs)
+	{
+		if (static_cast<std::size_t>(end - ptr) / GLYPH_ENTRY_SIZE < count) {
+			throw tref::DecodingError{"Invalid .tref file."};
+		}
+
+		const std::byte* const table{ptr};
+		ptr += std::size_t{count} * GLYPH_ENTRY_SIZE;
+		if (!glyphs.empty() && reuseGlyphNodes(glyphs, table, count, options)) {
+			return;
+		}
+
+		glyphs.clear();
+		if (!filtersGlyphs(options)) {
+			reserveGlyphs(glyphs, count);
+		}
+		else if (options.glyphFilter == nullptr && isSortedGlyphTable(table, count)) {
+			addGlyphRanges(glyphs, table, count, options.codepoints);
+			return;
+		}
+		for (const std::byte* it{table}; it != ptr;) {
+			addGlyph(glyphs, readGlyphEntry(it, ptr), options);
+		}
+	}
+
+	template <class Scratch>
+	void decodeGlyphTable(const FileHeader& header, std::span<const std::byte> data, Scratch& scratch,
+						  const tref::DecodeOptions& options, tref::GlyphMap& glyphs)
+	{
+		if (std::size_t{header.glyphCount} * GLYPH_ENTRY_SIZE / LZ4_MAX_RATIO > data.size()) {
+			throw tref::DecodingError{"Invalid .tref file."};
+		}
+		scratch.resize(std::size_t{header.glyphCount} * GLYPH_ENTRY_SIZE);
+		const int reportedSize{LZ4_decompress_safe(reinterpret_cast<const char*>(data.data()),
+												   reinterpret_cast<char*>(scratch.data()), data.size(),
+												   scratch.size())};
+		if (static_cast<std::size_t>(reportedSize) != scratch.size()) {
+			throw tref::DecodingError{"Decompression of .tref file failed."};
+		}
+
+		const std::byte* it{scratch.data()};
+		readGlyphTable(it, scratch.data() + scratch.size(), header.glyphCount, options, glyphs);
+	}
+
+	template void decodeGlyphTable(const FileHeader&, std::span<const std::byte>, std::vector<std::byte>&,
+								   const tref::DecodeOptions&, tref::GlyphMap&);
+	template void decodeGlyphTable(const FileHeader&, std::span<const std::byte>, std::pmr::vector<std::byte>&,
+								   const tref::DecodeOptions&, tref::GlyphMap&);
+
+	BandDecoder::BandDecoder(const TileLayout& layout, const tref::Rect& region, std::pmr::memory_resource* resource,
+							 bool timed, tref::TraceSink* trace)
+		: _layout{layout}
+		, _region{region}
+		, _timed{timed}
+		, _trace{trace}
+		, _scratch{resource}
+		, _tile(std::size_t{layout.tileWidth} * layout.tileHeight * 4, resource)
+		, _band(std::size_t{region.width} * std::min(layout.tileHeight, region.height) * 4, resource)
+		, _rows{0}
+		, _lz4Time{0}
+		, _qoiTime{0}
+	{
+	}
+
+	unsigned int BandDecoder::decode(unsigned int row,
+									 const std::function<std::span<const std::byte>(std::size_t)>& tileData)
+	{
+		const unsigned int top{std::max(_region.y, row * _layout.tileHeight)};
+		const unsigned int bottom{std::min(_region.y + _region.height, (row + 1) * _layout.tileHeight)};
+		const unsigned int firstColumn{_region.x / _layout.tileWidth};
+		const unsigned int lastColumn{(_region.x + _region.width - 1) / _layout.tileWidth};
+		for (unsigned int column = firstColumn; column <= lastColumn; ++column) {
+			const std::size_t index{std::size_t{row} * _layout.columns + column};
+			const tref::Rect  rect{_layout.tileRect(index)};
+			decodeTile(tileData(index), _layout.rawSizes[index], rect, _scratch, _tile.data(), _trace,
+					   _timed ? &_lz4Time : nullptr, _timed ? &_qoiTime : nullptr);
+
+			const unsigned int left{std::max(_region.x, rect.x)};
+			const unsigned int right{std::min(_region.x + _region.width, rect.x + rect.width)};
+			for (unsigned int y = top; y < bottom; ++y) {
+				std::memcpy(_band.data() + (std::size_t{y - top} * _region.width + left - _region.x) * 4,
+							_tile.data() + (std::size_t{y - rect.y} * rect.width + left - rect.x) * 4,
+							std::size_t{right - left} * 4);
+			}
+		}
+		_rows = bottom - top;
+		return top - _region.y;
+	}
+
+	const std::byte* BandDecoder::pixels() const noexcept
+	{
+		return _band.data();
+	}
+
+	unsigned int BandDecoder::rows() const noexcept
+	{
+		return _rows;
+	}
+
+	void BandDecoder::addTimes(tref::DecodeStats& stats) const noexcept
+	{
+		stats.lz4Time += _lz4Time;
+		stats.qoiTime += _qoiTime;
+	}
+
+	void decodeTiles(const TileLayout& layout, const tref::Rect& region, PixelWriter& writer,
+					 const std::function<std::span<const std::byte>(std::size_t)>& tileData,
+					 tref::DecodeStats* stats, tref::TraceSink* trace, const tref::DecodeOptions* options)
+	{
+		writer.begin(region.width, region.height, tref::Rect{0, 0, region.width, region.height});
+		if (region.width == 0 || region.height == 0) {
+			return;
+		}
+
+		const unsigned int firstRow{region.y / layout.tileHeight};
+		const unsigned int lastRow{(region.y + region.height - 1) / layout.tileHeight};
+		if (options != nullptr && isParallel(*options) && writer.random() && lastRow > firstRow) {
+			// Rows of tiles are independent, so they can be decoded and written straight to the output concurrently.
+			std::mutex                                mutex;
+			std::vector<std::unique_ptr<BandDecoder>> decoders;
+			parallelFor(options->executor, options->threads, lastRow - firstRow + 1, [&](std::size_t i) {
+				checkStop(*options);
+				std::unique_ptr<BandDecoder> decoder;
+				{
+					std::lock_guard lock{mutex};
+					if (!decoders.empty()) {
+						decoder = std::move(decoders.back());
+						decoders.pop_back();
+					}
+				}
+				if (decoder == nullptr) {
+					decoder = std::make_unique<BandDecoder>(layout, region, writer.resource(), stats != nullptr, trace);
+				}
+
+				const unsigned int top{decoder->decode(firstRow + static_cast<unsigned int>(i), tileData)};
+				writer.writeRows(top, decoder->pixels(), decoder->rows());
+
+				std::lock_guard lock{mutex};
+				decoders.push_back(std::move(decoder));
+			});
+			if (stats != nullptr) {
+				for (const auto& decoder : decoders) {
+					decoder->addTimes(*stats);
+				}
+			}
+			return;
+		}
+
+		// Rows of tiles are decoded one at a time into a band covering the region, which is then written out in order.
+		BandDecoder decoder{layout, region, writer.resource(), stats != nullptr, trace};
+		for (unsigned int row = firstRow; row <= lastRow; ++row) {
+			if (options != nullptr) {
+				checkStop(*options);
+			}
+			decoder.decode(row, tileData);
+			writer.write(decoder.pixels(), std::size_t{decoder.rows()} * region.width);
+		}
+		if (stats != nullptr) {
+			decoder.addTimes(*stats);
+		}
+	}
+} // namespace tref::detail
\ No newline at end of file
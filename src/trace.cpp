@@ -0,0 +1,58 @@
+#include "../include/tref/tref.hpp"
+#include <atomic>
+#include <fstream>
+
+namespace tref::detail {
+	// Gets a small number identifying the calling thread in traces.
+	unsigned int traceThreadId() noexcept
+	{
+		static std::atomic<unsigned int> nextId{1};
+		thread_local const unsigned int  id{nextId++};
+		return id;
+	}
+} // namespace tref::detail
+
+struct tref::ChromeTraceSink::Impl {
+	std::mutex                            mutex;
+	std::ofstream                         file;
+	std::chrono::steady_clock::time_point start{std::chrono::steady_clock::now()};
+	bool                                  empty{true};
+
+	// Writes a trace event. Stage names are string literals without characters needing to be escaped in JSON.
+	void write(const char* stage, char phase) noexcept
+	{
+		const std::chrono::nanoseconds time{std::chrono::steady_clock::now() - start};
+		const long long                ns{time.count()};
+		const unsigned int             tid{detail::traceThreadId()};
+
+		std::lock_guard lock{mutex};
+		file << (empty ? "\n" : ",\n") << R"({"name":")" << stage << R"(","cat":"tref","ph":")" << phase << R"(","ts":)"
+			 << ns / 1000 << '.' << ns / 100 % 10 << ns / 10 % 10 << ns % 10 << R"(,"pid":1,"tid":)" << tid << '}';
+		empty = false;
+	}
+};
+
+tref::ChromeTraceSink::ChromeTraceSink(const std::filesystem::path& path)
+	: _impl{std::make_unique<Impl>()}
+{
+	_impl->file.open(path, std::ios::binary);
+	if (!_impl->file.is_open()) {
+		throw FileError{"Failed to open trace file."};
+	}
+	_impl->file << '[';
+}
+
+tref::ChromeTraceSink::~ChromeTraceSink() noexcept
+{
+	_impl->file << "\n]\n";
+}
+
+void tref::ChromeTraceSink::begin(const char* stage) noexcept
+{
+	_impl->write(stage, 'B');
+}
+
+void tref::ChromeTraceSink::end(const char* stage) noexcept
+{
+	_impl->write(stage, 'E');
+}
\ No newline at end of file
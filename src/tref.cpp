@@ -1,25 +1,84 @@
-#include "../include/tref/tref.hpp"
-#include <cstring>
+#include "common.hpp"
+#include <algorithm>
+#include <climits>
 #include <lz4.h>
-#include <sstream>
+#include <lz4hc.h>
 #include <vector>
 
 #define QOI_IMPLEMENTATION
 #include "../include/tref/qoi.h"
 
-tref::DecodedBitmap::DecodedBitmap(std::byte* data, unsigned int width, unsigned int height) noexcept
-	: _data{data}, _width{width}, _height{height}
+namespace tref::detail {
+	// Amount of QOI chunk data decoded between cancellation checks.
+	inline constexpr std::size_t CANCELLATION_SLICE_SIZE{64 * 1024};
+} // namespace tref::detail
+
+tref::DecodedBitmap::DecodedBitmap(std::byte* data, unsigned int width, unsigned int height, PixelFormat format,
+								   std::pmr::memory_resource* resource) noexcept
+	: _data{data}
+	, _width{width}
+	, _height{height}
+	, _format{format}
+	, _resource{resource}
+	, _capacity{data != nullptr ? std::size_t{width} * height * bytesPerPixel(format) : 0}
+{
+}
+
+tref::DecodedBitmap::DecodedBitmap(std::byte* data, unsigned int width, unsigned int height, PixelFormat format,
+								   Deleter deleter) noexcept
+	: _data{data}
+	, _width{width}
+	, _height{height}
+	, _format{format}
+	, _resource{nullptr}
+	, _deleter{std::move(deleter)}
+	, _capacity{data != nullptr ? std::size_t{width} * height * bytesPerPixel(format) : 0}
+{
+}
+
+tref::DecodedBitmap::DecodedBitmap(DecodedBitmap&& r) noexcept
+	: _data{std::exchange(r._data, nullptr)}
+	, _width{std::exchange(r._width, 0)}
+	, _height{std::exchange(r._height, 0)}
+	, _format{r._format}
+	, _resource{r._resource}
+	, _deleter{std::move(r._deleter)}
+	, _capacity{std::exchange(r._capacity, 0)}
 {
 }
 
 tref::DecodedBitmap::~DecodedBitmap() noexcept
 {
-	std::free(_data);
+	if (_data == nullptr) {
+		return;
+	}
+	else if (_deleter != nullptr) {
+		_deleter(_data);
+	}
+	else if (_resource != nullptr) {
+		_resource->deallocate(_data, _capacity, alignof(std::max_align_t));
+	}
+	else {
+		std::free(_data);
+	}
+}
+
+tref::DecodedBitmap& tref::DecodedBitmap::operator=(DecodedBitmap&& r) noexcept
+{
+	DecodedBitmap old{std::move(r)};
+	std::swap(_data, old._data);
+	std::swap(_width, old._width);
+	std::swap(_height, old._height);
+	std::swap(_format, old._format);
+	std::swap(_resource, old._resource);
+	std::swap(_deleter, old._deleter);
+	std::swap(_capacity, old._capacity);
+	return *this;
 }
 
 std::span<const std::byte> tref::DecodedBitmap::data() const noexcept
 {
-	return {_data, _width * _height * 4};
+	return {_data, std::size_t{_width} * _height * bytesPerPixel(_format)};
 }
 
 unsigned int tref::DecodedBitmap::width() const noexcept
@@ -32,90 +91,743 @@ unsigned int tref::DecodedBitmap::height() const noexcept
 	return _height;
 }
 
-template <class T> T readBinary(const std::byte*& ptr, const std::byte* end)
+tref::PixelFormat tref::DecodedBitmap::format() const noexcept
 {
-	if ((end - ptr) < static_cast<std::ptrdiff_t>(sizeof(T))) {
-		throw tref::DecodingError{"Invalid .tref file."};
-	}
+	return _format;
+}
 
-	T value;
-	std::memcpy(&value, ptr, sizeof(T));
-	ptr += sizeof(T);
-	return value;
+tref::DecodedBitmap::Deleter tref::DecodedBitmap::deleter() const
+{
+	if (_deleter != nullptr) {
+		return _deleter;
+	}
+	else if (_resource != nullptr) {
+		return [resource = _resource, size = _capacity](std::byte* data) {
+			resource->deallocate(data, size, alignof(std::max_align_t));
+		};
+	}
+	else {
+		return [](std::byte* data) { std::free(data); };
+	}
 }
 
-template <class T> void writeBinary(std::ostream& os, const T& value) noexcept
+std::byte* tref::DecodedBitmap::release() noexcept
 {
-	os.write(reinterpret_cast<const char*>(&value), sizeof(value));
+	_width    = 0;
+	_height   = 0;
+	_capacity = 0;
+	_resource = nullptr;
+	_deleter  = nullptr;
+	return std::exchange(_data, nullptr);
 }
 
-template <class T> void writeBinaryRange(std::ostream& os, const T& range) noexcept
+std::span<std::byte> tref::DecodedBitmap::resize(unsigned int width, unsigned int height, PixelFormat format,
+												 std::pmr::memory_resource* resource)
 {
-	os.write(reinterpret_cast<const char*>(range.data()), range.size());
+	const std::size_t size{std::size_t{width} * height * bytesPerPixel(format)};
+	if (size > _capacity) {
+		*this = DecodedBitmap{detail::allocateBitmap(size, resource), width, height, format, resource};
+	}
+	_width  = width;
+	_height = height;
+	_format = format;
+	return {_data, size};
 }
 
-tref::DecodingResult tref::decode(std::span<const std::byte> data)
+namespace tref::detail {
+	std::byte* allocateBitmap(std::size_t size, std::pmr::memory_resource* resource)
+	{
+		if (size == 0) {
+			return nullptr;
+		}
+		else if (resource != nullptr) {
+			return static_cast<std::byte*>(resource->allocate(size, alignof(std::max_align_t)));
+		}
+
+		std::byte* const data{static_cast<std::byte*>(std::malloc(size))};
+		if (data == nullptr) {
+			throw std::bad_alloc{};
+		}
+		return data;
+	}
+
+	void recordStats(const tref::DecodeOptions& options, std::size_t fileSize, std::size_t decompressedSize,
+					 const tref::DecodingInfo& info) noexcept
+	{
+		if (options.stats != nullptr) {
+			options.stats->fileSize         = fileSize;
+			options.stats->decompressedSize = decompressedSize;
+			options.stats->bitmapSize       = std::size_t{info.width} * info.height *
+											  tref::bytesPerPixel(options.outputFormat);
+			options.stats->glyphCount       = info.glyphs.size();
+		}
+	}
+} // namespace tref::detail
+
+tref::Rect tref::glyphBounds(const GlyphMap& glyphs) noexcept
 {
-	const std::byte* it{data.data()};
-	const std::byte* end{data.data() + data.size()};
+	unsigned int left{UINT_MAX}, top{UINT_MAX}, right{0}, bottom{0};
+	for (const auto& [cp, glyph] : glyphs) {
+		if (glyph.width != 0 && glyph.height != 0) {
+			left   = std::min<unsigned int>(left, glyph.x);
+			top    = std::min<unsigned int>(top, glyph.y);
+			right  = std::max<unsigned int>(right, glyph.x + glyph.width);
+			bottom = std::max<unsigned int>(bottom, glyph.y + glyph.height);
+		}
+	}
+	return right == 0 ? Rect{0, 0, 0, 0} : Rect{left, top, right - left, bottom - top};
+}
+
+namespace tref::detail {
+	bool filtersGlyphs(const tref::DecodeOptions& options) noexcept
+	{
+		return !options.codepoints.empty() || options.glyphFilter != nullptr;
+	}
+
+	bool selectsGlyph(tref::Codepoint cp, const tref::DecodeOptions& options)
+	{
+		const auto inRange{[&](const tref::CodepointRange& range) {
+			return cp >= range.first && cp <= range.last;
+		}};
+
+		return (options.codepoints.empty() || std::ranges::any_of(options.codepoints, inRange)) &&
+			   (options.glyphFilter == nullptr || options.glyphFilter(cp));
+	}
+
+	void addGlyph(tref::GlyphMap& glyphs, const std::pair<tref::Codepoint, tref::Glyph>& entry,
+				  const tref::DecodeOptions& options)
+	{
+		if (selectsGlyph(entry.first, options)) {
+			glyphs.emplace(entry);
+		}
+	}
+
+	tref::Rect outputRegion(tref::GlyphMap& glyphs, const qoi_desc& desc, const tref::DecodeOptions& options) noexcept
+	{
+		if (!options.cropBitmap) {
+			return tref::Rect{0, 0, desc.width, desc.height};
+		}
+
+		const tref::Rect   bounds{tref::glyphBounds(glyphs)};
+		const unsigned int left{std::min(bounds.x, desc.width)};
+		const unsigned int top{std::min(bounds.y, desc.height)};
+		const unsigned int right{std::min(bounds.x + bounds.width, desc.width)};
+		const unsigned int bottom{std::min(bounds.y + bounds.height, desc.height)};
+		const tref::Rect   region{right > left && bottom > top ? tref::Rect{left, top, right - left, bottom - top}
+															   : tref::Rect{0, 0, 0, 0}};
+
+		for (auto& [cp, glyph] : glyphs) {
+			if (glyph.width != 0 && glyph.height != 0) {
+				glyph.x -= region.x;
+				glyph.y -= region.y;
+			}
+			else {
+				glyph.x = 0;
+				glyph.y = 0;
+			}
+		}
+		return region;
+	}
+
+	// Writes a value into a buffer, returning the position after it.
+	template <class T> std::byte* writeBinary(std::byte* ptr, const T& value) noexcept
+	{
+		std::memcpy(ptr, &value, sizeof(T));
+		return ptr + sizeof(T);
+	}
+
+	// Writes the entries of a glyph table into a buffer, returning the position after them. The entries are sorted by
+	// codepoint, so the output doesn't depend on the iteration order of the glyph map.
+	std::byte* writeGlyphTable(std::byte* ptr, const tref::GlyphMap& glyphs)
+	{
+		std::vector<std::pair<tref::Codepoint, tref::Glyph>> entries{glyphs.begin(), glyphs.end()};
+		std::ranges::sort(entries, {}, &std::pair<tref::Codepoint, tref::Glyph>::first);
+		for (const auto& [cp, glyph] : entries) {
+			ptr = writeBinary(ptr, cp);
+			ptr = writeBinary(ptr, glyph);
+		}
+		return ptr;
+	}
+
+	// Largest acceleration factor of LZ4_compress_fast(), beyond which LZ4 clamps it.
+	constexpr int LZ4_ACCELERATION_MAX{65537};
+
+	// LZ4 compressor using the compression set in encoding options, with its state reused between calls.
+	class Lz4Compressor {
+	  public:
+		explicit Lz4Compressor(const tref::EncodeOptions& options)
+			: _compression{options.compression}, _level{clampLevel(options.compression, options.level)}
+		{
+			switch (_compression) {
+			case tref::Compression::DEFAULT:
+				break;
+			case tref::Compression::FAST:
+				_state = std::make_unique_for_overwrite<std::byte[]>(LZ4_sizeofState());
+				break;
+			case tref::Compression::HIGH:
+				_state = std::make_unique_for_overwrite<std::byte[]>(LZ4_sizeofStateHC());
+				break;
+			}
+		}
+
+		// Compresses data as a single LZ4 block appended to a buffer. Returns the compressed size, or 0 if compression
+		// failed, in which case nothing is appended.
+		std::size_t append(std::vector<std::byte>& buffer, std::span<const std::byte> data)
+		{
+			const std::size_t offset{buffer.size()};
+			buffer.resize(offset + LZ4_compressBound(data.size()));
+			const char* const src{reinterpret_cast<const char*>(data.data())};
+			char* const       dst{reinterpret_cast<char*>(buffer.data() + offset)};
+			const int         capacity{static_cast<int>(buffer.size() - offset)};
+			int               size{0};
+			switch (_compression) {
+			case tref::Compression::DEFAULT:
+				size = LZ4_compress_default(src, dst, data.size(), capacity);
+				break;
+			case tref::Compression::FAST:
+				size = LZ4_compress_fast_extState(_state.get(), src, dst, data.size(), capacity, _level);
+				break;
+			case tref::Compression::HIGH:
+				size = LZ4_compress_HC_extStateHC(_state.get(), src, dst, data.size(), capacity, _level);
+				break;
+			}
+			buffer.resize(offset + size);
+			return size;
+		}
+
+	  private:
+		// Clamps a compression level to the range documented for a compression, as LZ4 HC would otherwise take levels
+		// below 1 as its default level.
+		static int clampLevel(tref::Compression compression, int level) noexcept
+		{
+			switch (compression) {
+			case tref::Compression::FAST:
+				return std::clamp(level, 1, LZ4_ACCELERATION_MAX);
+			case tref::Compression::HIGH:
+				return level == 0 ? LZ4HC_CLEVEL_DEFAULT : std::clamp(level, 1, LZ4HC_CLEVEL_MAX);
+			default:
+				return level;
+			}
+		}
+
+		tref::Compression            _compression;
+		int                          _level;
+		std::unique_ptr<std::byte[]> _state;
+	};
+
+	template <class Scratch> FileHeader decompressPayload(std::span<const std::byte> data, Scratch& scratch)
+	{
+		const std::byte* it{data.data()};
+		const std::byte* end{data.data() + data.size()};
+
+		const FileHeader header{readFileHeader(it, end)};
+		if (header.rawSize / LZ4_MAX_RATIO > static_cast<std::size_t>(end - it)) {
+			throw tref::DecodingError{"Invalid .tref file."};
+		}
+		scratch.resize(header.rawSize);
+		const int reportedSize{LZ4_decompress_safe(reinterpret_cast<const char*>(it),
+												   reinterpret_cast<char*>(scratch.data()), end - it, scratch.size())};
+		if (static_cast<std::uint32_t>(reportedSize) != scratch.size()) {
+			throw tref::DecodingError{"Decompression of .tref file failed."};
+		}
+		return header;
+	}
+
+	template FileHeader decompressPayload(std::span<const std::byte>, std::vector<std::byte>&);
+	template FileHeader decompressPayload(std::span<const std::byte>, std::pmr::vector<std::byte>&);
+
+	// Decodes a tiled tref file, writing the bitmap through a pixel writer and the glyphs into a glyph map whose nodes
+	// are reused.
+	template <class Scratch>
+	tref::DecodingInfo decodeTiled(std::span<const std::byte> data, Scratch& scratch, PixelWriter& writer,
+								   const tref::DecodeOptions& options, tref::GlyphMap glyphs)
+	{
+		const std::byte* it{data.data()};
+		const std::byte* end{data.data() + data.size()};
+
+		const FileHeader header{readFileHeader(it, end)};
+		TileLayout       layout{header};
+		readTileTable(layout, it, end);
+		if (static_cast<std::size_t>(end - it) < header.glyphTableSize ||
+			static_cast<std::size_t>(end - it) - header.glyphTableSize < layout.offsets.back()) {
+			throw tref::DecodingError{"Invalid .tref file."};
+		}
+		const std::span<const std::byte> glyphTable{it, header.glyphTableSize};
+		it += header.glyphTableSize;
 
-	if (std::string_view{readBinary<std::array<char, 4>>(it, end).data(), 4} != "TREF") {
-		throw DecodingError{"Invalid .tref file header."};
+		tref::Rect region;
+
+		// The glyph table and bitmap are independent unless the bitmap is cropped, so they may be decoded concurrently.
+		const auto readGlyphs{[&] {
+			const StageTimer timer{options, GLYPH_TABLE_STAGE, &tref::DecodeStats::glyphTime};
+			decodeGlyphTable(header, glyphTable, scratch, options, glyphs);
+		}};
+		const auto tileData{[&](std::size_t index) {
+			return std::span<const std::byte>{it + layout.offsets[index], it + layout.offsets[index + 1]};
+		}};
+		if (isPipelined(options)) {
+			region = tref::Rect{0, 0, header.width, header.height};
+			runConcurrently(options.executor, readGlyphs, [&] {
+				decodeTiles(layout, region, writer, tileData, options.stats, options.trace, &options);
+			});
+		}
+		else {
+			readGlyphs();
+			region = outputRegion(glyphs, qoi_desc{header.width, header.height, 4, QOI_SRGB}, options);
+			decodeTiles(layout, region, writer, tileData, options.stats, options.trace, &options);
+		}
+
+		return tref::DecodingInfo{header.lineSkip, std::move(glyphs), region.width, region.height};
 	}
 
-	std::vector<std::byte> raw(readBinary<std::uint32_t>(it, end));
-	std::vector<std::byte> lz4{it, end};
-	const int              reportedSize{LZ4_decompress_safe(reinterpret_cast<const char*>(lz4.data()),
-															reinterpret_cast<char*>(raw.data()), lz4.size(), raw.size())};
-	if (static_cast<std::uint32_t>(reportedSize) != raw.size()) {
-		throw DecodingError{"Decompression of .tref file failed."};
+	// Count of glyph table bytes handed over from the thread decompressing a file to the thread reading the table.
+	class GlyphTableFeed {
+	  public:
+		// Makes more bytes of the table available.
+		void publish(std::size_t count)
+		{
+			std::lock_guard lock{_mutex};
+			_available += count;
+			_changed.notify_all();
+		}
+
+		// Wakes up the reading thread when the rest of the table will never be available.
+		void abandon()
+		{
+			std::lock_guard lock{_mutex};
+			_abandoned = true;
+			_changed.notify_all();
+		}
+
+		// Waits until more than count bytes of the table are available and returns their number. Throws DecodingError
+		// if the table was abandoned first.
+		std::size_t wait(std::size_t count)
+		{
+			std::unique_lock lock{_mutex};
+			_changed.wait(lock, [&] { return _available > count || _abandoned; });
+			if (_available <= count) {
+				throw tref::DecodingError{"Invalid .tref file."};
+			}
+			return _available;
+		}
+
+	  private:
+		std::mutex              _mutex;
+		std::condition_variable _changed;
+		std::size_t             _available{0};
+		bool                    _abandoned{false};
+	};
+
+	// Decodes a version 1 or 2 tref file with the glyph table built concurrently with the bitmap. The payload is
+	// decompressed as a stream on the calling thread, which hands the glyph table over to the other thread as it is
+	// decompressed and then decodes the bitmap from the window of the stream.
+	template <class Scratch>
+	tref::DecodingInfo decodePipelined(std::span<const std::byte> data, Scratch& scratch, PixelWriter& writer,
+									   const tref::DecodeOptions& options, tref::GlyphMap glyphs)
+	{
+		const std::byte* it{data.data()};
+		const std::byte* end{data.data() + data.size()};
+
+		const FileHeader header{readFileHeader(it, end)};
+		if (header.rawSize / LZ4_MAX_RATIO > static_cast<std::size_t>(end - it)) {
+			throw tref::DecodingError{"Invalid .tref file."};
+		}
+		Lz4Stream lz4{header.rawSize, writer.resource()};
+
+		// Decompresses input until at least count bytes of decompressed data are available.
+		const auto pull{[&](std::size_t count) {
+			while (lz4.available().size() < count) {
+				if (lz4.done() || it == end) {
+					throw tref::DecodingError{"Invalid .tref file."};
+				}
+				checkStop(options);
+				const StageTimer timer{options, LZ4_DECOMPRESS_STAGE, &tref::DecodeStats::lz4Time};
+				it += lz4.feed({it, end});
+			}
+			return lz4.available();
+		}};
+
+		std::span<const std::byte> payload{pull(8)};
+		const std::byte*           pit{payload.data()};
+		const std::int32_t         lineSkip{readBinary<std::int32_t>(pit, payload.data() + payload.size())};
+		const std::uint32_t        count{readBinary<std::uint32_t>(pit, payload.data() + payload.size())};
+		lz4.consume(8);
+		if ((header.rawSize - 8) / GLYPH_ENTRY_SIZE < count) {
+			throw tref::DecodingError{"Invalid .tref file."};
+		}
+		checkGlyphLimit(count, options);
+		scratch.resize(std::size_t{count} * GLYPH_ENTRY_SIZE);
+
+		GlyphTableFeed feed;
+
+		// Reads the glyph table on the other thread.
+		const auto readGlyphs{[&] {
+			const StageTimer timer{options, GLYPH_TABLE_STAGE, &tref::DecodeStats::glyphTime};
+			const std::byte* table{scratch.data()};
+			const std::byte* tableEnd{scratch.data() + scratch.size()};
+
+			// Reusing the nodes of the glyph map and selecting codepoint ranges need the whole table, otherwise the
+			// glyphs are added as soon as they are decompressed.
+			if (!glyphs.empty() || !options.codepoints.empty()) {
+				if (table != tableEnd) {
+					feed.wait(scratch.size() - 1);
+				}
+				readGlyphTable(table, tableEnd, count, options, glyphs);
+				return;
+			}
+
+			if (!filtersGlyphs(options)) {
+				glyphs.reserve(count);
+			}
+			while (table != tableEnd) {
+				const std::size_t available{feed.wait(table - scratch.data() + GLYPH_ENTRY_SIZE - 1)};
+				const std::byte*  availableEnd{scratch.data() + available / GLYPH_ENTRY_SIZE * GLYPH_ENTRY_SIZE};
+				while (table != availableEnd) {
+					addGlyph(glyphs, readGlyphEntry(table, availableEnd), options);
+				}
+			}
+		}};
+
+		// Hands the glyph table over to the other thread and decodes the bitmap on the calling thread.
+		qoi_desc   desc;
+		const auto decodeBitmap{[&] {
+			try {
+				for (std::size_t copied{0}; copied < scratch.size();) {
+					payload = pull(1);
+					const std::size_t size{std::min(payload.size(), scratch.size() - copied)};
+					std::memcpy(scratch.data() + copied, payload.data(), size);
+					lz4.consume(size);
+					copied += size;
+					feed.publish(size);
+				}
+			}
+			catch (...) {
+				feed.abandon();
+				throw;
+			}
+
+			payload = pull(QOI_HEADER_BYTES);
+			pit     = payload.data();
+			desc    = readQoiHeader(pit, payload.data() + payload.size());
+			lz4.consume(QOI_HEADER_BYTES);
+			checkFileHeader(header, lineSkip, count, desc);
+			checkBitmapLimit(desc.width, desc.height, options);
+			if (header.rawSize - lz4.offset() < QOI_END_MARKER_BYTES) {
+				throw tref::DecodingError{"Failed to decode .tref file image data."};
+			}
+
+			writer.begin(desc.width, desc.height, tref::Rect{0, 0, desc.width, desc.height});
+			const std::size_t chunksEnd{header.rawSize - QOI_END_MARKER_BYTES};
+			QoiDecoder        qoi;
+			while (true) {
+				{
+					const StageTimer timer{options, QOI_DECODE_STAGE, &tref::DecodeStats::qoiTime};
+					payload = lz4.available().first(std::min(lz4.available().size(), chunksEnd - lz4.offset()));
+					pit     = payload.data();
+					const bool complete{writer.decode(qoi, pit, payload.data() + payload.size())};
+					lz4.consume(pit - payload.data());
+					if (complete) {
+						break;
+					}
+					else if (lz4.offset() + lz4.available().size() >= chunksEnd) {
+						writer.fill(qoi);
+						break;
+					}
+				}
+				pull(lz4.available().size() + 1);
+			}
+		}};
+		runConcurrently(options.executor, readGlyphs, decodeBitmap);
+
+		return tref::DecodingInfo{lineSkip, std::move(glyphs), desc.width, desc.height};
 	}
-	it  = raw.data();
-	end = raw.data() + raw.size();
 
-	const std::int32_t  lineSkip{readBinary<std::int32_t>(it, end)};
-	const std::uint32_t count{readBinary<std::uint32_t>(it, end)};
-	GlyphMap            glyphs;
-	for (std::uint32_t i = 0; i < count; ++i) {
-		glyphs.emplace(readBinary<Codepoint>(it, end), readBinary<Glyph>(it, end));
+	// Decodes a version 1 or 2 tref file, writing the bitmap through a pixel writer and the glyphs into a glyph map
+	// whose nodes are reused.
+	template <class Scratch>
+	tref::DecodingInfo decodeUntiled(std::span<const std::byte> data, Scratch& scratch, PixelWriter& writer,
+									 const tref::DecodeOptions& options, tref::GlyphMap glyphs)
+	{
+		if (isPipelined(options)) {
+			return decodePipelined(data, scratch, writer, options, std::move(glyphs));
+		}
+
+		FileHeader header;
+		{
+			const StageTimer timer{options, LZ4_DECOMPRESS_STAGE, &tref::DecodeStats::lz4Time};
+			header = decompressPayload(data, scratch);
+		}
+		checkStop(options);
+		const std::byte* it{scratch.data()};
+		const std::byte* end{scratch.data() + scratch.size()};
+
+		const std::int32_t  lineSkip{readBinary<std::int32_t>(it, end)};
+		const std::uint32_t count{readBinary<std::uint32_t>(it, end)};
+		if (static_cast<std::size_t>(end - it) / GLYPH_ENTRY_SIZE < count) {
+			throw tref::DecodingError{"Invalid .tref file."};
+		}
+		checkGlyphLimit(count, options);
+		const std::byte* glyphTable{it};
+		it += std::size_t{count} * GLYPH_ENTRY_SIZE;
+
+		const qoi_desc desc{readQoiHeader(it, end)};
+		checkFileHeader(header, lineSkip, count, desc);
+		checkBitmapLimit(desc.width, desc.height, options);
+		if (static_cast<std::size_t>(end - it) < QOI_END_MARKER_BYTES) {
+			throw tref::DecodingError{"Failed to decode .tref file image data."};
+		}
+
+		{
+			const StageTimer timer{options, GLYPH_TABLE_STAGE, &tref::DecodeStats::glyphTime};
+			readGlyphTable(glyphTable, end, count, options, glyphs);
+		}
+		const tref::Rect region{outputRegion(glyphs, desc, options)};
+
+		writer.begin(desc.width, desc.height, region);
+		const StageTimer timer{options, QOI_DECODE_STAGE, &tref::DecodeStats::qoiTime};
+		QoiDecoder       qoi;
+		if (!options.stopToken.stop_possible()) {
+			if (!writer.decode(qoi, it, end - QOI_END_MARKER_BYTES)) {
+				writer.fill(qoi);
+			}
+		}
+		else {
+			// The chunks are decoded in slices so that cancellation is checked regularly.
+			const std::byte* chunksEnd{end - QOI_END_MARKER_BYTES};
+			for (const std::byte* sliceEnd{it}; !writer.decode(qoi, it, sliceEnd);) {
+				if (sliceEnd == chunksEnd) {
+					writer.fill(qoi);
+					break;
+				}
+				checkStop(options);
+				sliceEnd = it + std::min<std::size_t>(chunksEnd - it, CANCELLATION_SLICE_SIZE);
+			}
+		}
+
+		return tref::DecodingInfo{lineSkip, std::move(glyphs), region.width, region.height};
 	}
 
-	qoi_desc   desc;
-	std::byte* bitmap{static_cast<std::byte*>(qoi_decode(it, std::distance(it, end), &desc, 4))};
-	if (bitmap == nullptr) {
-		throw DecodingError{"Failed to decode .tref file image data."};
+	// Decodes a tref file, writing the bitmap through a pixel writer and the glyphs into a glyph map whose nodes are
+	// reused.
+	template <class Scratch>
+	tref::DecodingInfo decode(std::span<const std::byte> data, Scratch& scratch, PixelWriter& writer,
+							  const tref::DecodeOptions& options, tref::GlyphMap glyphs)
+	{
+		if (options.stats != nullptr) {
+			*options.stats = {};
+		}
+
+		FileHeader header;
+		{
+			const StageTimer timer{options.trace, HEADER_STAGE, nullptr};
+			const std::byte* it{data.data()};
+			header = readFileHeader(it, data.data() + data.size());
+			checkLimits(header, options);
+		}
+		tref::DecodingInfo info{header.version == 3 ? decodeTiled(data, scratch, writer, options, std::move(glyphs))
+													: decodeUntiled(data, scratch, writer, options, std::move(glyphs))};
+		recordStats(options, data.size(), header.rawSize, info);
+		return info;
 	}
+} // namespace tref::detail
+
+tref::DecodingResult tref::decode(std::span<const std::byte> data, const DecodeOptions& options)
+{
+	detail::ScratchResource     resource{options};
+	std::pmr::vector<std::byte> scratch{resource.get()};
+	return detail::decodeToNewBitmap(options, [&](const BitmapTarget& target) {
+		detail::PixelWriter writer{target, options.outputFormat, resource.get()};
+		return detail::decode(data, scratch, writer, options, tref::GlyphMap{detail::memoryResource(options)});
+	});
+}
 
-	return DecodingResult{lineSkip, std::move(glyphs), DecodedBitmap{bitmap, desc.width, desc.height}};
+tref::DecodingInfo tref::decode(std::span<const std::byte> data, std::vector<std::byte>& scratch,
+								const BitmapTarget& target, const DecodeOptions& options)
+{
+	detail::ScratchResource resource{options};
+	detail::PixelWriter     writer{target, options.outputFormat, resource.get()};
+	return detail::decode(data, scratch, writer, options, tref::GlyphMap{detail::memoryResource(options)});
+}
+
+tref::DecodingInfo tref::decode(std::span<const std::byte> data, std::vector<std::byte>& scratch, const RowSink& sink,
+								unsigned int batchRows, const DecodeOptions& options)
+{
+	detail::ScratchResource resource{options};
+	detail::PixelWriter     writer{sink, batchRows, options.outputFormat, resource.get()};
+	return detail::decode(data, scratch, writer, options, tref::GlyphMap{detail::memoryResource(options)});
 }
 
-void tref::encode(std::ostream& os, std::int32_t lineSkip, const GlyphMap& glyphs, const BitmapRef& bitmap)
+void tref::decodeInto(std::span<const std::byte> data, DecodingResult& result, std::vector<std::byte>& scratch,
+					  const DecodeOptions& options)
 {
-	const qoi_desc             desc{bitmap.width, bitmap.height, 4, QOI_SRGB};
-	int                        size;
-	std::span<const std::byte> qoi{static_cast<const std::byte*>(qoi_encode(bitmap.data, &desc, &size)),
-								   static_cast<std::size_t>(size)};
-	if (qoi.data() == nullptr) {
-		throw EncodingError{"Failed to encode .tref file image data."};
+	// The bitmap data is only replaced if it's too small, which is counted as an allocation like in decode().
+	const BitmapTarget target{[&](unsigned int width, unsigned int height) {
+		const std::byte* const     previous{result.bitmap.data().data()};
+		const std::span<std::byte> pixels{
+			result.bitmap.resize(width, height, options.outputFormat, options.memoryResource)};
+		if (options.stats != nullptr && pixels.data() != previous) {
+			++options.stats->allocations;
+		}
+		return pixels;
+	}};
+
+	detail::ScratchResource resource{options};
+	detail::PixelWriter     writer{target, options.outputFormat, resource.get()};
+	DecodingInfo            info{detail::decode(data, scratch, writer, options, std::move(result.glyphs))};
+	result.lineSkip = info.lineSkip;
+	result.glyphs   = std::move(info.glyphs);
+}
+
+namespace tref::detail {
+	// Encodes a tiled tref file into an empty buffer.
+	void encodeTiled(std::vector<std::byte>& buffer, std::int32_t lineSkip, const tref::GlyphMap& glyphs,
+					 const tref::BitmapRef& bitmap, const tref::EncodeOptions& options)
+	{
+		FileHeader header{};
+		header.width      = bitmap.width;
+		header.height     = bitmap.height;
+		header.tileWidth  = options.tileWidth == 0 ? bitmap.width : std::min(options.tileWidth, bitmap.width);
+		header.tileHeight = options.tileHeight == 0 ? bitmap.height : std::min(options.tileHeight, bitmap.height);
+		const TileLayout  layout{header};
+		const std::size_t tileCount{std::size_t{layout.columns} * layout.rows};
+
+		const std::size_t glyphTableSize{glyphs.size() * GLYPH_ENTRY_SIZE};
+		if (glyphTableSize > LZ4_MAX_INPUT_SIZE) {
+			throw tref::EncodingError{".tref file is too large to encode."};
+		}
+		const auto glyphTable{std::make_unique_for_overwrite<std::byte[]>(glyphTableSize)};
+		{
+			const StageTimer timer{options, GLYPH_TABLE_STAGE, &tref::EncodeStats::glyphTime};
+			writeGlyphTable(glyphTable.get(), glyphs);
+		}
+
+		// The header and tile table are filled in once all tiles are compressed.
+		buffer.resize(FILE_HEADER_V3_BYTES + tileCount * TILE_ENTRY_SIZE);
+		Lz4Compressor lz4{options};
+		std::size_t   glyphLz4Size;
+		{
+			const StageTimer timer{options, LZ4_COMPRESS_STAGE, &tref::EncodeStats::lz4Time};
+			glyphLz4Size = lz4.append(buffer, {glyphTable.get(), glyphTableSize});
+		}
+
+		// Each tile is QOI-encoded on its own, straight from the bitmap, then LZ4-compressed unless that doesn't make
+		// it smaller.
+		const std::size_t maxTileSize{maxQoiSize(header.tileWidth, header.tileHeight)};
+		const auto        qoi{std::make_unique_for_overwrite<std::byte[]>(maxTileSize)};
+		std::uint64_t     rawSize{glyphTableSize};
+		for (std::size_t i = 0; i < tileCount; ++i) {
+			const tref::Rect rect{layout.tileRect(i)};
+			std::size_t      size;
+			{
+				const StageTimer timer{options, QOI_ENCODE_STAGE, &tref::EncodeStats::qoiTime};
+				size = encodeQoi(bitmap.data + (std::size_t{rect.y} * bitmap.width + rect.x) * 4, rect.width,
+								 rect.height, std::size_t{bitmap.width} * 4, qoi.get());
+			}
+
+			const std::size_t offset{buffer.size()};
+			std::size_t       compressedSize;
+			{
+				const StageTimer timer{options, LZ4_COMPRESS_STAGE, &tref::EncodeStats::lz4Time};
+				compressedSize = lz4.append(buffer, {qoi.get(), size});
+			}
+			if (compressedSize == 0 || compressedSize >= size) {
+				buffer.resize(offset + size);
+				std::memcpy(buffer.data() + offset, qoi.get(), size);
+			}
+			std::byte* entry{buffer.data() + FILE_HEADER_V3_BYTES + i * TILE_ENTRY_SIZE};
+			entry = writeBinary(entry, static_cast<std::uint32_t>(buffer.size() - offset));
+			writeBinary(entry, static_cast<std::uint32_t>(size));
+			rawSize += size;
+		}
+		if (rawSize > UINT32_MAX) {
+			throw tref::EncodingError{".tref file is too large to encode."};
+		}
+
+		std::byte* it{buffer.data()};
+		std::memcpy(it, "TRF3", 4);
+		it = writeBinary(it + 4, lineSkip);
+		it = writeBinary(it, static_cast<std::uint32_t>(glyphs.size()));
+		it = writeBinary(it, static_cast<std::uint32_t>(bitmap.width));
+		it = writeBinary(it, static_cast<std::uint32_t>(bitmap.height));
+		it = writeBinary(it, static_cast<std::uint32_t>(rawSize));
+		it = writeBinary(it, static_cast<std::uint32_t>(header.tileWidth));
+		it = writeBinary(it, static_cast<std::uint32_t>(header.tileHeight));
+		writeBinary(it, static_cast<std::uint32_t>(glyphLz4Size));
+
+		if (options.stats != nullptr) {
+			options.stats->fileSize         = buffer.size();
+			options.stats->decompressedSize = rawSize;
+		}
 	}
+} // namespace tref::detail
 
-	std::ostringstream buffer{std::ios::binary};
-	writeBinary(buffer, lineSkip);
-	writeBinary(buffer, static_cast<std::uint32_t>(glyphs.size()));
-	for (auto& [cp, glyph] : glyphs) {
-		writeBinary(buffer, cp);
-		writeBinary(buffer, glyph);
+void tref::encodeToBuffer(std::vector<std::byte>& buffer, std::int32_t lineSkip, const GlyphMap& glyphs,
+						  const BitmapRef& bitmap, const EncodeOptions& options)
+{
+	if (options.stats != nullptr) {
+		*options.stats            = {};
+		options.stats->bitmapSize = std::size_t{bitmap.width} * bitmap.height * 4;
+		options.stats->glyphCount = glyphs.size();
+	}
+	buffer.clear();
+	if (options.tileWidth != 0 || options.tileHeight != 0) {
+		detail::encodeTiled(buffer, lineSkip, glyphs, bitmap, options);
+		return;
 	}
-	writeBinaryRange(buffer, qoi);
 
-	const std::string raw{std::move(buffer).str()};
-	if (raw.size() > LZ4_MAX_INPUT_SIZE) {
+	// The payload is assembled in a single pass, with the bitmap QOI-encoded straight after the glyph table, then
+	// compressed straight into the buffer after the header. The payload is compressed as a single LZ4 block, so it must
+	// be contiguous.
+	const std::size_t maxRawSize{8 + glyphs.size() * detail::GLYPH_ENTRY_SIZE +
+								 detail::maxQoiSize(bitmap.width, bitmap.height)};
+	const auto        raw{std::make_unique_for_overwrite<std::byte[]>(maxRawSize)};
+	std::byte*        it{raw.get()};
+	it = detail::writeBinary(it, lineSkip);
+	it = detail::writeBinary(it, static_cast<std::uint32_t>(glyphs.size()));
+	{
+		const detail::StageTimer timer{options, detail::GLYPH_TABLE_STAGE, &EncodeStats::glyphTime};
+		it = detail::writeGlyphTable(it, glyphs);
+	}
+	{
+		const detail::StageTimer timer{options, detail::QOI_ENCODE_STAGE, &EncodeStats::qoiTime};
+		it += detail::encodeQoi(bitmap.data, bitmap.width, bitmap.height, std::size_t{bitmap.width} * 4, it);
+	}
+	const std::size_t rawSize{static_cast<std::size_t>(it - raw.get())};
+	if (rawSize > LZ4_MAX_INPUT_SIZE) {
 		throw EncodingError{".tref file is too large to encode."};
 	}
-	std::vector<std::byte> lz4(LZ4_compressBound(raw.size()));
-	lz4.resize(LZ4_compress_default(raw.c_str(), reinterpret_cast<char*>(lz4.data()), raw.size(), lz4.size()));
 
-	os.write("TREF", 4);
-	writeBinary(os, static_cast<std::uint32_t>(raw.size()));
-	writeBinaryRange(os, lz4);
+	buffer.resize(detail::FILE_HEADER_V2_BYTES);
+	{
+		const detail::StageTimer timer{options, detail::LZ4_COMPRESS_STAGE, &EncodeStats::lz4Time};
+		detail::Lz4Compressor{options}.append(buffer, {raw.get(), rawSize});
+	}
+
+	it = buffer.data();
+	std::memcpy(it, "TRF2", 4);
+	it = detail::writeBinary(it + 4, lineSkip);
+	it = detail::writeBinary(it, static_cast<std::uint32_t>(glyphs.size()));
+	it = detail::writeBinary(it, static_cast<std::uint32_t>(bitmap.width));
+	it = detail::writeBinary(it, static_cast<std::uint32_t>(bitmap.height));
+	detail::writeBinary(it, static_cast<std::uint32_t>(rawSize));
+
+	if (options.stats != nullptr) {
+		options.stats->fileSize         = buffer.size();
+		options.stats->decompressedSize = rawSize;
+	}
+}
+
+void tref::encode(const WriteCallback& write, std::int32_t lineSkip, const GlyphMap& glyphs, const BitmapRef& bitmap,
+				  const EncodeOptions& options)
+{
+	std::vector<std::byte> buffer;
+	encodeToBuffer(buffer, lineSkip, glyphs, bitmap, options);
+	write(buffer);
+}
+
+void tref::encode(std::ostream& os, std::int32_t lineSkip, const GlyphMap& glyphs, const BitmapRef& bitmap,
+				  const EncodeOptions& options)
+{
+	encode([&](std::span<const std::byte> data) { os.write(reinterpret_cast<const char*>(data.data()), data.size()); },
+		   lineSkip, glyphs, bitmap, options);
 }
\ No newline at end of file
@@ -0,0 +1,189 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+// Replaces the global allocation functions to count the allocations made by the program. Must only be included by one
+// source file of a test.
+
+namespace tref::test {
+	// Totals of the allocations made since the program started.
+	struct AllocationTotals {
+		std::atomic<std::size_t> count{0};
+		std::atomic<std::size_t> bytes{0};
+		std::atomic<std::size_t> largest{0};
+	};
+
+	inline AllocationTotals allocationTotals;
+
+	// Allocations made during the lifetime of an object.
+	class AllocationCounter {
+	  public:
+		AllocationCounter() noexcept
+			: _count{allocationTotals.count}, _bytes{allocationTotals.bytes}
+		{
+			allocationTotals.largest = 0;
+		}
+
+		// Gets the number of allocations made so far.
+		std::size_t count() const noexcept
+		{
+			return allocationTotals.count - _count;
+		}
+
+		// Gets the number of bytes allocated so far.
+		std::size_t bytes() const noexcept
+		{
+			return allocationTotals.bytes - _bytes;
+		}
+
+		// Gets the size of the largest allocation made so far.
+		std::size_t largest() const noexcept
+		{
+			return allocationTotals.largest;
+		}
+
+	  private:
+		std::size_t _count;
+		std::size_t _bytes;
+	};
+
+	inline void* countedAllocate(std::size_t size, std::size_t alignment) noexcept
+	{
+		++allocationTotals.count;
+		allocationTotals.bytes += size;
+		for (std::size_t largest{allocationTotals.largest};
+			 size > largest && !allocationTotals.largest.compare_exchange_weak(largest, size);) {
+		}
+
+		size = std::max<std::size_t>(size, 1);
+#ifdef _WIN32
+		return _aligned_malloc(size, alignment);
+#else
+		if (alignment <= alignof(std::max_align_t)) {
+			return std::malloc(size);
+		}
+		return std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+#endif
+	}
+
+	inline void countedFree(void* ptr) noexcept
+	{
+#ifdef _WIN32
+		_aligned_free(ptr);
+#else
+		std::free(ptr);
+#endif
+	}
+
+	inline void* countedAllocateOrThrow(std::size_t size, std::size_t alignment)
+	{
+		void* const ptr{countedAllocate(size, alignment)};
+		if (ptr == nullptr) {
+			throw std::bad_alloc{};
+		}
+		return ptr;
+	}
+} // namespace tref::test
+
+void* operator new(std::size_t size)
+{
+	return tref::test::countedAllocateOrThrow(size, alignof(std::max_align_t));
+}
+
+void* operator new[](std::size_t size)
+{
+	return tref::test::countedAllocateOrThrow(size, alignof(std::max_align_t));
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+	return tref::test::countedAllocateOrThrow(size, static_cast<std::size_t>(alignment));
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment)
+{
+	return tref::test::countedAllocateOrThrow(size, static_cast<std::size_t>(alignment));
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+	return tref::test::countedAllocate(size, alignof(std::max_align_t));
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+	return tref::test::countedAllocate(size, alignof(std::max_align_t));
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+	return tref::test::countedAllocate(size, static_cast<std::size_t>(alignment));
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+	return tref::test::countedAllocate(size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void* ptr) noexcept
+{
+	tref::test::countedFree(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+	tref::test::countedFree(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+	tref::test::countedFree(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept
+{
+	tref::test::countedFree(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept
+{
+	tref::test::countedFree(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t) noexcept
+{
+	tref::test::countedFree(ptr);
+}
+
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept
+{
+	tref::test::countedFree(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept
+{
+	tref::test::countedFree(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept
+{
+	tref::test::countedFree(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept
+{
+	tref::test::countedFree(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept
+{
+	tref::test::countedFree(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept
+{
+	tref::test::countedFree(ptr);
+}
\ No newline at end of file
@@ -0,0 +1,51 @@
+#include "test.hpp"
+#include <algorithm>
+#include <climits>
+
+// Files encoded with every compression and level must decode to the font that was encoded, untiled and tiled. Levels
+// outside the documented ranges must give the same files as the levels they are clamped to.
+int main()
+{
+	const tref::test::Atlas atlas{tref::test::makeAtlas(300, 200, 80, 4, true)};
+
+	const auto encode{[&](tref::Compression compression, int level, unsigned int tileSize) {
+		tref::EncodeOptions options{tileSize, tileSize};
+		options.compression = compression;
+		options.level = level;
+		return tref::test::encode(atlas, options);
+	}};
+
+	for (const unsigned int tileSize : {0u, 64u}) {
+		std::vector<std::pair<tref::Compression, int>> cases{{tref::Compression::DEFAULT, 0}};
+		for (int level = 0; level <= 12; ++level) {
+			cases.emplace_back(tref::Compression::HIGH, level);
+		}
+		for (const int level : {0, 1, 2, 8, 100, 65537}) {
+			cases.emplace_back(tref::Compression::FAST, level);
+		}
+		for (const int level : {INT_MIN, -1, 13, INT_MAX}) {
+			cases.emplace_back(tref::Compression::FAST, level);
+			cases.emplace_back(tref::Compression::HIGH, level);
+		}
+
+		for (const auto& [compression, level] : cases) {
+			const tref::DecodingResult result{tref::decode(encode(compression, level, tileSize))};
+			CHECK(result.glyphs == atlas.glyphs);
+			CHECK(std::ranges::equal(result.bitmap.data(), atlas.pixels));
+		}
+
+		const std::pair<int, int> fastClamps[]{{INT_MIN, 1}, {-1, 1}, {0, 1}, {65538, 65537}, {INT_MAX, 65537}};
+		for (const auto& [level, clamped] : fastClamps) {
+			CHECK(encode(tref::Compression::FAST, level, tileSize) ==
+				  encode(tref::Compression::FAST, clamped, tileSize));
+		}
+		const std::pair<int, int> highClamps[]{{INT_MIN, 1}, {-1, 1}, {0, 9}, {13, 12}, {INT_MAX, 12}};
+		for (const auto& [level, clamped] : highClamps) {
+			CHECK(encode(tref::Compression::HIGH, level, tileSize) ==
+				  encode(tref::Compression::HIGH, clamped, tileSize));
+		}
+	}
+
+	// Low HC levels differ from the default one on this atlas, so level 1 isn't mistaken for the default.
+	CHECK(encode(tref::Compression::HIGH, 1, 0) != encode(tref::Compression::HIGH, 9, 0));
+}
\ No newline at end of file
@@ -0,0 +1,49 @@
+#include "allocations.hpp"
+#include "test.hpp"
+#include <algorithm>
+
+namespace {
+	// Checks that a decoding result holds a font.
+	void checkResult(const tref::DecodingResult& result, const tref::test::Atlas& atlas)
+	{
+		CHECK(result.glyphs == atlas.glyphs);
+		CHECK(result.bitmap.width() == atlas.width && result.bitmap.height() == atlas.height);
+		CHECK(std::ranges::equal(result.bitmap.data(), atlas.pixels));
+	}
+} // namespace
+
+// Reloading fonts with decodeInto() must not allocate once the result and scratch buffer are large enough, as long as
+// the number of glyphs stays the same.
+int main()
+{
+	// Fonts with the same glyph count but different pixels, the second one with different codepoints and the last one
+	// with a smaller bitmap.
+	tref::test::Atlas atlases[]{tref::test::makeAtlas(384, 256, 100, 1), tref::test::makeAtlas(384, 256, 100, 2),
+								tref::test::makeAtlas(384, 200, 100, 3, true)};
+	tref::GlyphMap    shifted;
+	for (const auto& [cp, glyph] : atlases[1].glyphs) {
+		shifted.emplace(cp + 1, glyph);
+	}
+	atlases[1].glyphs = std::move(shifted);
+
+	std::vector<std::vector<std::byte>> files;
+	for (const tref::test::Atlas& atlas : atlases) {
+		files.push_back(tref::test::encode(atlas));
+	}
+
+	// The first round grows the result and scratch buffer to fit every font.
+	tref::DecodingResult   result{tref::decode(files[0])};
+	std::vector<std::byte> scratch;
+	for (const std::vector<std::byte>& file : files) {
+		tref::decodeInto(file, result, scratch);
+	}
+
+	for (int round = 0; round < 3; ++round) {
+		for (std::size_t i = 0; i < files.size(); ++i) {
+			const tref::test::AllocationCounter counter;
+			tref::decodeInto(files[i], result, scratch);
+			CHECK(counter.count() == 0);
+			checkResult(result, atlases[i]);
+		}
+	}
+}
\ No newline at end of file
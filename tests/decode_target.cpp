@@ -0,0 +1,31 @@
+#include "allocations.hpp"
+#include "test.hpp"
+#include <cstring>
+
+// Decoding into a caller-provided buffer with a warm scratch buffer must only allocate the glyph map: no copy of the
+// input, no buffer for the decompressed payload and no buffer for the bitmap.
+int main()
+{
+	const tref::test::Atlas      atlas{tref::test::makeAtlas(512, 512, 300)};
+	const std::vector<std::byte> file{tref::test::encode(atlas)};
+	std::vector<std::byte>       scratch;
+	std::vector<std::byte>       pixels(atlas.pixels.size());
+
+	const tref::BitmapTarget target{[&](unsigned int width, unsigned int height) {
+		CHECK(width == atlas.width && height == atlas.height);
+		return std::span<std::byte>{pixels};
+	}};
+
+	tref::decode(file, scratch, target);
+	const std::byte* const scratchData{scratch.data()};
+	for (int i = 0; i < 3; ++i) {
+		std::ranges::fill(pixels, std::byte{0});
+		const tref::test::AllocationCounter counter;
+		const tref::DecodingInfo            info{tref::decode(file, scratch, target)};
+		CHECK(counter.largest() < file.size() / 16);
+		CHECK(counter.count() <= info.glyphs.size() + 8);
+		CHECK(scratch.data() == scratchData);
+		CHECK(info.glyphs == atlas.glyphs);
+		CHECK(pixels == atlas.pixels);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,63 @@
+#include "test.hpp"
+#include <algorithm>
+#include <functional>
+#include <memory_resource>
+#include <string_view>
+
+namespace {
+	// Hashes the contents of an encoded file.
+	std::size_t hash(const std::vector<std::byte>& file)
+	{
+		return std::hash<std::string_view>{}({reinterpret_cast<const char*>(file.data()), file.size()});
+	}
+} // namespace
+
+// Encoding must produce the same bytes no matter in which order the glyphs were inserted into the glyph map, how many
+// buckets it has or which memory resource it uses, so that builds of a font are reproducible.
+int main()
+{
+	const tref::test::Atlas                                    atlas{tref::test::makeAtlas(512, 256, 200, 5)};
+	const std::vector<std::pair<tref::Codepoint, tref::Glyph>> entries{atlas.glyphs.begin(), atlas.glyphs.end()};
+	std::pmr::monotonic_buffer_resource                        resource;
+
+	for (const tref::EncodeOptions& options : {tref::EncodeOptions{}, tref::EncodeOptions{64, 64}}) {
+		std::vector<std::byte> reference;
+		for (unsigned int variant = 0; variant < 6; ++variant) {
+			tref::test::Atlas permuted{atlas.width, atlas.height, atlas.pixels,
+									   tref::GlyphMap{variant == 5 ? &resource : std::pmr::get_default_resource()}};
+			std::vector<std::pair<tref::Codepoint, tref::Glyph>> order{entries};
+			switch (variant) {
+			case 1:
+				std::ranges::reverse(order);
+				break;
+			case 2:
+			case 3:
+			case 4:
+				std::ranges::shuffle(order, std::mt19937{variant});
+				break;
+			}
+			if (variant == 3) {
+				permuted.glyphs.reserve(4096);
+			}
+			else if (variant == 4) {
+				// Leaves buckets and nodes behind from other codepoints.
+				for (const auto& [cp, glyph] : order) {
+					permuted.glyphs.emplace(cp + 100000, glyph);
+				}
+				permuted.glyphs.clear();
+			}
+			permuted.glyphs.insert(order.begin(), order.end());
+
+			const std::vector<std::byte> file{tref::test::encode(permuted, options)};
+			if (variant == 0) {
+				reference = file;
+			}
+			CHECK(file == reference);
+			CHECK(hash(file) == hash(reference));
+
+			const tref::DecodingResult result{tref::decode(file)};
+			CHECK(result.glyphs == atlas.glyphs);
+			CHECK(std::ranges::equal(result.bitmap.data(), atlas.pixels));
+		}
+	}
+}
\ No newline at end of file
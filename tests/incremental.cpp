@@ -0,0 +1,85 @@
+#include "test.hpp"
+#include <algorithm>
+
+namespace {
+	// Decodes a file with an incremental decoder whose steps mix tiny and large budgets, checking the progress reported
+	// along the way.
+	tref::DecodingResult decodeInSteps(std::span<const std::byte> file, const tref::DecodeOptions& options,
+									   unsigned int seed)
+	{
+		constexpr tref::StepBudget TINY{1, 1, 1};
+		constexpr tref::StepBudget LARGE{1 << 20, 1 << 20, 1 << 16};
+
+		std::mt19937             rng{seed};
+		tref::IncrementalDecoder decoder{file, options};
+		std::size_t              bytesRead{0};
+		for (unsigned int steps = 0;; ++steps) {
+			tref::StepBudget budget;
+			switch (rng() % 4) {
+			case 0:
+				budget = TINY;
+				break;
+			case 1:
+				budget = LARGE;
+				break;
+			case 2:
+				// Tiny in some limits only.
+				budget = LARGE;
+				if (rng() % 2 == 0) {
+					budget.lz4Bytes = 1;
+				}
+				if (rng() % 2 == 0) {
+					budget.glyphs = 1;
+				}
+				if (rng() % 2 == 0) {
+					budget.rows = 1;
+				}
+				break;
+			default:
+				budget.lz4Bytes = rng() % 4096;
+				budget.glyphs   = rng() % 64;
+				budget.rows     = rng() % 16;
+				break;
+			}
+
+			const tref::DecodeProgress progress{decoder.step(budget)};
+			CHECK(progress.totalBytes == file.size());
+			CHECK(progress.bytesRead >= bytesRead && progress.bytesRead <= progress.totalBytes);
+			CHECK(steps < 1000000);
+			bytesRead = progress.bytesRead;
+			if (progress.done) {
+				CHECK(decoder.step(LARGE).done);
+				return decoder.result();
+			}
+		}
+	}
+} // namespace
+
+// Decoding a file in steps must produce the same result as decoding it at once, however the budgets of the steps are
+// mixed.
+int main()
+{
+	const tref::test::Atlas atlas{tref::test::makeAtlas(200, 150, 40, 7, true)};
+
+	std::vector<tref::DecodeOptions> cases(4);
+	cases[1].outputFormat = tref::PixelFormat::BGRA8;
+	cases[2].cropBitmap   = true;
+	cases[2].glyphFilter  = [](tref::Codepoint cp) { return cp >= 0x40 && cp < 0x60; };
+	cases[3].outputFormat = tref::PixelFormat::A8;
+
+	for (const tref::EncodeOptions& encodeOptions : {tref::EncodeOptions{}, tref::EncodeOptions{32, 48}}) {
+		const std::vector<std::byte> file{tref::test::encode(atlas, encodeOptions)};
+		for (const tref::DecodeOptions& options : cases) {
+			const tref::DecodingResult reference{tref::decode(file, options)};
+			for (unsigned int seed = 0; seed < 8; ++seed) {
+				const tref::DecodingResult result{decodeInSteps(file, options, seed)};
+				CHECK(result.lineSkip == reference.lineSkip);
+				CHECK(result.glyphs == reference.glyphs);
+				CHECK(result.bitmap.width() == reference.bitmap.width());
+				CHECK(result.bitmap.height() == reference.bitmap.height());
+				CHECK(result.bitmap.format() == reference.bitmap.format());
+				CHECK(std::ranges::equal(result.bitmap.data(), reference.bitmap.data()));
+			}
+		}
+	}
+}
\ No newline at end of file
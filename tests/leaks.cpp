@@ -0,0 +1,119 @@
+#include "test.hpp"
+#include <memory_resource>
+#include <mutex>
+
+namespace {
+	// Memory resource keeping track of the memory allocated through it that wasn't freed yet.
+	class TrackingResource : public std::pmr::memory_resource {
+	  public:
+		std::size_t outstanding() noexcept
+		{
+			std::lock_guard lock{_mutex};
+			return _outstanding;
+		}
+
+	  private:
+		std::mutex  _mutex;
+		std::size_t _outstanding{0};
+
+		void* do_allocate(std::size_t bytes, std::size_t alignment) override
+		{
+			void* const ptr{std::pmr::new_delete_resource()->allocate(bytes, alignment)};
+			std::lock_guard lock{_mutex};
+			_outstanding += bytes;
+			return ptr;
+		}
+
+		void do_deallocate(void* ptr, std::size_t bytes, std::size_t alignment) override
+		{
+			{
+				std::lock_guard lock{_mutex};
+				_outstanding -= bytes;
+			}
+			std::pmr::new_delete_resource()->deallocate(ptr, bytes, alignment);
+		}
+
+		bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+		{
+			return this == &other;
+		}
+	};
+
+	// Runs every way of decoding a file, with options that may set a memory resource.
+	void decodeAll(std::span<const std::byte> file, const tref::DecodeOptions& options)
+	{
+		tref::DecodingResult result{tref::decode(file, options)};
+
+		std::vector<std::byte> scratch;
+		tref::decodeInto(file, result, scratch, options);
+
+		// The released data outlives the bitmap until it's freed with the bitmap's deleter.
+		const tref::DecodedBitmap::Deleter deleter{result.bitmap.deleter()};
+		std::byte* const                   data{result.bitmap.release()};
+		CHECK(result.bitmap.data().empty());
+		deleter(data);
+
+		tref::decodeAsync(file, options).get();
+		tref::test::streamDecoder(file).decode(options);
+
+		tref::IncrementalDecoder incremental{file, options};
+		while (!incremental.step().done) {
+		}
+		incremental.result();
+
+		tref::Font font{{file.begin(), file.end()}, options};
+		font.bitmap();
+		font.releasePixels();
+		font.glyphPixels(0x20);
+	}
+
+	// Runs every way of decoding a file that fails to decode.
+	void decodeAllInvalid(std::span<const std::byte> file, const tref::DecodeOptions& options)
+	{
+		CHECK(tref::test::throws<tref::DecodingError>([&] { tref::decode(file, options); }));
+		CHECK(tref::test::throws<tref::DecodingError>([&] { tref::decodeAsync(file, options).get(); }));
+		CHECK(tref::test::throws<tref::DecodingError>([&] { tref::test::streamDecoder(file).decode(options); }));
+		CHECK(tref::test::throws<tref::DecodingError>([&] {
+			tref::IncrementalDecoder incremental{file, options};
+			while (!incremental.step().done) {
+			}
+		}));
+		CHECK(tref::test::throws<tref::DecodingError>([&] {
+			tref::Font font{{file.begin(), file.end()}, options};
+			font.bitmap();
+		}));
+	}
+} // namespace
+
+// Every memory allocated while encoding and decoding must be freed, including after a bitmap's data was released and
+// after decoding fails. Memory allocated through DecodeOptions::memoryResource is tracked here; building with
+// TREF_SANITIZE also checks everything else for leaks.
+int main()
+{
+	const tref::test::Atlas atlas{tref::test::makeAtlas(256, 256, 80, 1, true)};
+	for (const tref::EncodeOptions& encodeOptions : {tref::EncodeOptions{}, tref::EncodeOptions{64, 64}}) {
+		const std::vector<std::byte> file{tref::test::encode(atlas, encodeOptions)};
+		for (bool pipelined : {false, true}) {
+			TrackingResource    resource;
+			tref::DecodeOptions options;
+			options.pipelined = pipelined;
+			decodeAll(file, options);
+			decodeAllInvalid(std::span{file}.first(file.size() / 2), options);
+
+			options.memoryResource = &resource;
+			decodeAll(file, options);
+			decodeAllInvalid(std::span{file}.first(file.size() / 2), options);
+			CHECK(resource.outstanding() == 0);
+		}
+	}
+
+	// A custom deleter is forgotten by release(), along with anything it holds on to.
+	const std::shared_ptr<int> token{std::make_shared<int>()};
+	std::byte* const           data{new std::byte[4]};
+	tref::DecodedBitmap        bitmap{data, 1, 1, tref::PixelFormat::RGBA8, [token](std::byte* ptr) { delete[] ptr; }};
+
+	const tref::DecodedBitmap::Deleter deleter{bitmap.deleter()};
+	CHECK(bitmap.release() == data);
+	CHECK(token.use_count() == 2);
+	deleter(data);
+}
\ No newline at end of file
@@ -0,0 +1,152 @@
+#include "test.hpp"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <lz4.h>
+#include <memory_resource>
+
+namespace {
+	// Memory resource keeping track of the largest amount of memory allocated through it at once. Only used from one
+	// thread at a time.
+	class PeakResource : public std::pmr::memory_resource {
+	  public:
+		std::size_t peak() const noexcept
+		{
+			return _peak;
+		}
+
+	  private:
+		std::size_t _current{0};
+		std::size_t _peak{0};
+
+		void* do_allocate(std::size_t bytes, std::size_t alignment) override
+		{
+			void* const ptr{std::pmr::new_delete_resource()->allocate(bytes, alignment)};
+			_current += bytes;
+			_peak = std::max(_peak, _current);
+			return ptr;
+		}
+
+		void do_deallocate(void* ptr, std::size_t bytes, std::size_t alignment) override
+		{
+			_current -= bytes;
+			std::pmr::new_delete_resource()->deallocate(ptr, bytes, alignment);
+		}
+
+		bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+		{
+			return this == &other;
+		}
+	};
+
+	// Upper bound of the memory decoding a corrupt file may allocate before it finds out.
+	constexpr std::size_t MAX_EARLY_ALLOCATION{1024 * 1024};
+
+	void write32(std::vector<std::byte>& file, std::size_t offset, std::uint32_t value)
+	{
+		std::memcpy(file.data() + offset, &value, sizeof(value));
+	}
+
+	// Builds a version 3 header with no data after it.
+	std::vector<std::byte> tiledHeader(std::uint32_t width, std::uint32_t height, std::uint32_t tileWidth,
+									   std::uint32_t tileHeight, std::uint32_t rawSize)
+	{
+		std::vector<std::byte> file(36);
+		std::memcpy(file.data(), "TRF3", 4);
+		write32(file, 4, 0);
+		write32(file, 8, 0);
+		write32(file, 12, width);
+		write32(file, 16, height);
+		write32(file, 20, rawSize);
+		write32(file, 24, tileWidth);
+		write32(file, 28, tileHeight);
+		write32(file, 32, 0);
+		return file;
+	}
+
+	// Checks that decoding a file fails in every way it can be decoded, and that stream decoding doesn't allocate much
+	// before it does.
+	template <class Exception> void checkRejected(std::span<const std::byte> file, const tref::DecodeOptions& options)
+	{
+		CHECK(tref::test::throws<Exception>([&] { tref::decode(file, options); }));
+		CHECK(tref::test::throws<Exception>([&] { tref::Font{{file.begin(), file.end()}, options}.bitmap(); }));
+
+		PeakResource        resource;
+		tref::DecodeOptions streamOptions{options};
+		streamOptions.memoryResource = &resource;
+		CHECK(tref::test::throws<Exception>([&] { tref::test::streamDecoder(file).decode(streamOptions); }));
+		CHECK(resource.peak() < MAX_EARLY_ALLOCATION);
+	}
+
+	// Checks that every truncation of a file is rejected.
+	void testTruncation(std::span<const std::byte> file)
+	{
+		for (std::size_t size = 0; size < file.size(); size += 1 + size / 16) {
+			checkRejected<tref::DecodingError>(file.first(size), {});
+		}
+	}
+
+	// Checks that files claiming sizes far larger than their contents are rejected without allocating those sizes.
+	void testOversizedHeaders(const tref::test::Atlas& atlas)
+	{
+		// A tile table of 190 million entries.
+		checkRejected<tref::DecodingError>(tiledHeader(65535, 2900, 1, 1, 0xFFFFFFF0), {});
+
+		// A tile claiming to be almost 4 GiB large.
+		std::vector<std::byte> tiled{tref::test::encode(atlas, tref::EncodeOptions{0, 64})};
+		write32(tiled, 20, 0xFFFFFFF0);
+		write32(tiled, 36, 0xF0000000);
+		write32(tiled, 40, 0xF0000000);
+		checkRejected<tref::DecodingError>(tiled, {});
+
+		// A glyph table of 234 million entries, with only its count present.
+		const std::uint32_t      count{0x0E000000};
+		std::array<std::byte, 8> payload{};
+		std::memcpy(payload.data() + 4, &count, sizeof(count));
+		std::vector<std::byte> untiled(24 + LZ4_compressBound(payload.size()));
+		std::memcpy(untiled.data(), "TRF2", 4);
+		write32(untiled, 4, 0);
+		write32(untiled, 8, count);
+		write32(untiled, 12, 1);
+		write32(untiled, 16, 1);
+		write32(untiled, 20, 0xFFFFFFF0);
+		untiled.resize(24 + LZ4_compress_default(reinterpret_cast<const char*>(payload.data()),
+												 reinterpret_cast<char*>(untiled.data() + 24), payload.size(),
+												 untiled.size() - 24));
+		checkRejected<tref::DecodingError>(untiled, {});
+	}
+
+	// Checks that each limit of the decoding options is enforced.
+	void testLimits(std::span<const std::byte> file, const tref::test::Atlas& atlas)
+	{
+		const tref::ProbeInfo info{tref::probe(file)};
+		tref::DecodeOptions   options;
+		options.maxDecompressedSize = info.decompressedSize - 1;
+		checkRejected<tref::LimitError>(file, options);
+
+		options                 = {};
+		options.maxBitmapPixels = std::uint64_t{atlas.width} * atlas.height - 1;
+		checkRejected<tref::LimitError>(file, options);
+
+		options               = {};
+		options.maxGlyphCount = static_cast<std::uint32_t>(atlas.glyphs.size() - 1);
+		checkRejected<tref::LimitError>(file, options);
+
+		options.maxDecompressedSize = info.decompressedSize;
+		options.maxBitmapPixels     = std::uint64_t{atlas.width} * atlas.height;
+		options.maxGlyphCount       = static_cast<std::uint32_t>(atlas.glyphs.size());
+		CHECK(tref::decode(file, options).glyphs == atlas.glyphs);
+		CHECK(tref::test::streamDecoder(file).decode(options).glyphs == atlas.glyphs);
+	}
+} // namespace
+
+int main()
+{
+	const tref::test::Atlas atlas{tref::test::makeAtlas(256, 192, 60)};
+	for (const tref::EncodeOptions& options : {tref::EncodeOptions{}, tref::EncodeOptions{64, 64}}) {
+		const std::vector<std::byte> file{tref::test::encode(atlas, options)};
+		testTruncation(file);
+		testLimits(file, atlas);
+	}
+	testOversizedHeaders(atlas);
+}
\ No newline at end of file
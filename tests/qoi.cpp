@@ -0,0 +1,220 @@
+#include "../src/common.hpp"
+#include "test.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+	// Builds a QOI file of 4-channel pixels from a header and chunk data.
+	std::vector<std::byte> makeQoiFile(unsigned int width, unsigned int height, const std::vector<std::uint8_t>& chunks)
+	{
+		std::vector<std::uint8_t> bytes{'q', 'o', 'i', 'f'};
+		for (const unsigned int size : {width, height}) {
+			for (const int shift : {24, 16, 8, 0}) {
+				bytes.push_back(static_cast<std::uint8_t>(size >> shift));
+			}
+		}
+		bytes.push_back(4);
+		bytes.push_back(QOI_SRGB);
+		bytes.insert(bytes.end(), chunks.begin(), chunks.end());
+		bytes.insert(bytes.end(), {0, 0, 0, 0, 0, 0, 0, 1});
+
+		const std::span<const std::byte> file{std::as_bytes(std::span{bytes})};
+		return {file.begin(), file.end()};
+	}
+
+	// Encodes pixels into a QOI file with the reference encoder.
+	std::vector<std::byte> encodeQoi(const std::vector<std::byte>& pixels, unsigned int width, unsigned int height)
+	{
+		const qoi_desc   desc{width, height, 4, QOI_SRGB};
+		int              size;
+		void* const      data{qoi_encode(pixels.data(), &desc, &size)};
+		const std::byte* bytes{static_cast<const std::byte*>(data)};
+		CHECK(data != nullptr);
+		std::vector<std::byte> file{bytes, bytes + size};
+		std::free(data);
+		return file;
+	}
+
+	// Decodes a QOI file with the reference decoder.
+	std::vector<std::byte> decodeReference(const std::vector<std::byte>& file)
+	{
+		qoi_desc    desc;
+		void* const data{qoi_decode(file.data(), static_cast<int>(file.size()), &desc, 4)};
+		CHECK(data != nullptr);
+		const std::byte*       bytes{static_cast<const std::byte*>(data)};
+		std::vector<std::byte> pixels{bytes, bytes + std::size_t{desc.width} * desc.height * 4};
+		std::free(data);
+		return pixels;
+	}
+
+	// Decodes a QOI file with the library's decoder, making the chunk data available and requesting pixels in steps of
+	// the given sizes (cycled through), or all at once for a size of 0. Steps of input that end in the middle of a
+	// chunk exercise resuming decoding once the rest of the chunk is available.
+	std::vector<std::byte> decodeInSteps(const std::vector<std::byte>& file, std::span<const std::size_t> inputSteps,
+										 std::span<const std::size_t> outputSteps)
+	{
+		const std::byte*       it{file.data()};
+		const std::byte* const end{file.data() + file.size() - tref::detail::QOI_END_MARKER_BYTES};
+		const qoi_desc         desc{tref::detail::readQoiHeader(it, end)};
+		const std::size_t      pixelCount{std::size_t{desc.width} * desc.height};
+
+		std::vector<std::byte>   pixels(pixelCount * 4);
+		tref::detail::QoiDecoder decoder;
+		const std::byte*         available{it};
+		std::size_t              written{0};
+		for (std::size_t step = 0; written < pixelCount; ++step) {
+			const std::size_t inputStep{inputSteps[step % inputSteps.size()]};
+			const std::size_t outputStep{outputSteps[step % outputSteps.size()]};
+			available = inputStep == 0 ? end : std::min(available + inputStep, end);
+			const std::size_t remaining{pixelCount - written};
+			const std::size_t count{outputStep == 0 ? remaining : std::min(outputStep, remaining)};
+			const std::size_t decoded{decoder.decode(it, available, pixels.data() + written * 4, count)};
+			CHECK(decoded <= count);
+			written += decoded;
+			if (decoded < count && available == end) {
+				// The chunk data ends before the image does.
+				decoder.fill(pixels.data() + written * 4, pixelCount - written);
+				written = pixelCount;
+			}
+		}
+		return pixels;
+	}
+
+	// Checks that the library's decoder matches the reference decoder on a QOI file, however its input and output
+	// are split.
+	void checkDecoding(const std::vector<std::byte>& file, std::mt19937& rng)
+	{
+		const std::vector<std::byte> reference{decodeReference(file)};
+
+		const std::size_t whole[]{0};
+		CHECK(decodeInSteps(file, whole, whole) == reference);
+
+		// Splits around the sizes that decide between the fast and the exact loop: the largest chunk and the pixels
+		// written by a run.
+		for (const std::size_t size : {1, 2, 3, 4, 5, 6, 63, 64, 65, 127, 128, 129}) {
+			const std::size_t steps[]{size};
+			CHECK(decodeInSteps(file, steps, whole) == reference);
+			CHECK(decodeInSteps(file, whole, steps) == reference);
+		}
+
+		for (unsigned int i = 0; i < 8; ++i) {
+			std::vector<std::size_t> inputSteps(16), outputSteps(16);
+			std::ranges::generate(inputSteps, [&] { return std::size_t{rng() % 100 + 1}; });
+			std::ranges::generate(outputSteps, [&] { return std::size_t{rng() % 200 + 1}; });
+			CHECK(decodeInSteps(file, inputSteps, outputSteps) == reference);
+		}
+	}
+
+	// Checks that the library's QOI encoder produces the same bytes as the reference encoder for an image, and for a
+	// region of it read through the image's stride.
+	void checkEncoding(const std::vector<std::byte>& pixels, unsigned int width, unsigned int height)
+	{
+		const auto encode{[&](unsigned int x, unsigned int y, unsigned int regionWidth, unsigned int regionHeight) {
+			std::vector<std::byte> file(tref::detail::maxQoiSize(regionWidth, regionHeight));
+			file.resize(tref::detail::encodeQoi(pixels.data() + (std::size_t{y} * width + x) * 4, regionWidth,
+												regionHeight, std::size_t{width} * 4, file.data()));
+			return file;
+		}};
+		CHECK(encode(0, 0, width, height) == encodeQoi(pixels, width, height));
+		if (width < 2 || height < 2) {
+			return;
+		}
+
+		const unsigned int     x{width / 3}, y{height / 4}, regionWidth{width / 2}, regionHeight{height / 2};
+		std::vector<std::byte> region;
+		for (unsigned int row = y; row < y + regionHeight; ++row) {
+			const auto start{pixels.begin() + (std::size_t{row} * width + x) * 4};
+			region.insert(region.end(), start, start + std::size_t{regionWidth} * 4);
+		}
+		CHECK(encode(x, y, regionWidth, regionHeight) == encodeQoi(region, regionWidth, regionHeight));
+	}
+
+	// Generates a random chunk of each kind (except runs, when runs is false) and appends it to chunk data.
+	void appendRandomChunk(std::vector<std::uint8_t>& chunks, std::mt19937& rng, bool runs = true)
+	{
+		switch (rng() % (runs ? 6 : 5)) {
+		case 0:
+			chunks.push_back(static_cast<std::uint8_t>(0x00 | rng() % 64));
+			break;
+		case 1:
+			chunks.push_back(static_cast<std::uint8_t>(0x40 | rng() % 64));
+			break;
+		case 2:
+			chunks.push_back(static_cast<std::uint8_t>(0x80 | rng() % 64));
+			chunks.push_back(static_cast<std::uint8_t>(rng()));
+			break;
+		case 3:
+			chunks.push_back(0xfe);
+			for (int i = 0; i < 3; ++i) {
+				chunks.push_back(static_cast<std::uint8_t>(rng()));
+			}
+			break;
+		case 4:
+			chunks.push_back(0xff);
+			for (int i = 0; i < 4; ++i) {
+				chunks.push_back(static_cast<std::uint8_t>(rng()));
+			}
+			break;
+		default:
+			chunks.push_back(static_cast<std::uint8_t>(0xc0 | rng() % 62));
+			break;
+		}
+	}
+} // namespace
+
+// The library's QOI decoder must produce the same pixels as the reference qoi_decode on any chunk data, including
+// data the reference encoder never produces, however the data and output are split. Its encoder must produce the same
+// bytes as the reference qoi_encode.
+int main()
+{
+	std::mt19937 rng{1};
+
+	// Encoder output for font atlases and random pixels.
+	for (const bool colored : {false, true}) {
+		const tref::test::Atlas atlas{tref::test::makeAtlas(150, 100, 30, 3, colored)};
+		checkDecoding(encodeQoi(atlas.pixels, atlas.width, atlas.height), rng);
+		checkEncoding(atlas.pixels, atlas.width, atlas.height);
+	}
+	for (const unsigned int range : {2u, 16u, 256u}) {
+		std::vector<std::byte> pixels(97 * 61 * 4);
+		std::ranges::generate(pixels, [&] { return static_cast<std::byte>(rng() % range); });
+		checkDecoding(encodeQoi(pixels, 97, 61), rng);
+		checkEncoding(pixels, 97, 61);
+	}
+
+	// Long runs, cut at 62 pixels, and runs at the end of the image.
+	for (const unsigned int width : {1u, 61u, 62u, 63u, 124u, 125u, 200u}) {
+		std::vector<std::byte> pixels(std::size_t{width} * 3 * 4);
+		std::fill(pixels.begin() + pixels.size() / 3, pixels.end(), std::byte{7});
+		checkEncoding(pixels, width, 3);
+	}
+
+	// A run at the start of the image, of the initial pixel, which isn't in the index.
+	checkDecoding(makeQoiFile(70, 1, {0xc0 | 9, 0x00 | 53, 0xc0 | 40, 0x40 | 0x15, 0x00 | 53}), rng);
+
+	// Index lookups of entries never written, which hold zero pixels at positions other than their hash, followed by
+	// chunks relative to them.
+	checkDecoding(makeQoiFile(16, 1, {0x00 | 5, 0x40 | 0x3f, 0x00 | 0, 0x00 | 63, 0xc0 | 2, 0x80 | 40, 0x7f, 0x00 | 5,
+									  0x00 | 0, 0xfe, 1, 2, 3, 0x00 | 17}),
+				  rng);
+
+	// Runs that end past the point where 64 output pixels no longer remain, in images of sizes around it.
+	for (unsigned int width = 60; width < 140; ++width) {
+		std::vector<std::uint8_t> chunks{0xff, 10, 20, 30, 40};
+		for (unsigned int i = 0; i < 4; ++i) {
+			chunks.push_back(0xc0 | 61);
+			chunks.push_back(0x40 | static_cast<std::uint8_t>(i));
+		}
+		checkDecoding(makeQoiFile(width, 1, chunks), rng);
+	}
+
+	// Random chunk data, some of which ends before the image does and some of which has chunks left over.
+	for (unsigned int i = 0; i < 200; ++i) {
+		std::vector<std::uint8_t> chunks;
+		const std::size_t         chunkCount{rng() % 400};
+		for (std::size_t j = 0; j < chunkCount; ++j) {
+			appendRandomChunk(chunks, rng, i % 2 == 0);
+		}
+		checkDecoding(makeQoiFile(rng() % 64 + 1, rng() % 64 + 1, chunks), rng);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,110 @@
+#include "../src/common.hpp"
+#include "test.hpp"
+#include <algorithm>
+#include <string>
+
+namespace {
+	// Bytes written past the end of the output, which kernels must leave alone.
+	constexpr std::size_t GUARD_BYTES{64};
+
+	// Runs a kernel on pixels starting at an offset in bytes into the input and output, and gets what it wrote,
+	// checking that it wrote nothing outside of its output.
+	std::vector<std::byte> convert(tref::detail::PixelKernel kernel, const std::vector<std::byte>& pixels,
+								   std::size_t inputOffset, std::size_t outputOffset, std::size_t outputPixelSize)
+	{
+		const std::size_t      count{(pixels.size() - inputOffset) / 4};
+		const std::size_t      outputSize{count * outputPixelSize};
+		std::vector<std::byte> out(outputOffset + outputSize + GUARD_BYTES, std::byte{0xa5});
+		kernel(pixels.data() + inputOffset, out.data() + outputOffset, count);
+		CHECK(std::all_of(out.begin(), out.begin() + outputOffset, [](std::byte b) { return b == std::byte{0xa5}; }));
+		CHECK(std::all_of(out.end() - GUARD_BYTES, out.end(), [](std::byte b) { return b == std::byte{0xa5}; }));
+		return {out.begin() + outputOffset, out.end() - GUARD_BYTES};
+	}
+
+	// Checks that the kernels of an instruction set produce the same bytes as the scalar ones on pixels, read and
+	// written at aligned and unaligned addresses.
+	void checkKernels(const tref::detail::PixelKernels& kernels, const std::vector<std::byte>& pixels)
+	{
+		const tref::detail::PixelKernels& scalar{tref::detail::pixelKernels(tref::detail::SimdLevel::SCALAR)};
+		for (const std::size_t offset : {0, 1, 4}) {
+			const std::vector<std::byte> shifted{[&] {
+				std::vector<std::byte> bytes(offset);
+				bytes.insert(bytes.end(), pixels.begin(), pixels.end());
+				return bytes;
+			}()};
+
+			for (const std::size_t outputOffset : {0, 3}) {
+				CHECK(convert(kernels.toBgra, shifted, offset, outputOffset, 4) ==
+					  convert(scalar.toBgra, shifted, offset, outputOffset, 4));
+				CHECK(convert(kernels.toA8, shifted, offset, outputOffset, 1) ==
+					  convert(scalar.toA8, shifted, offset, outputOffset, 1));
+				CHECK(convert(kernels.toPremultipliedRgba, shifted, offset, outputOffset, 4) ==
+					  convert(scalar.toPremultipliedRgba, shifted, offset, outputOffset, 4));
+			}
+		}
+	}
+
+	// Sets an environment variable for the rest of the process.
+	void setEnvironment(const char* name, const char* value)
+	{
+#ifdef _WIN32
+		_putenv_s(name, value);
+#else
+		setenv(name, value, 1);
+#endif
+	}
+} // namespace
+
+// Every SIMD variant of the pixel kernels supported by the CPU must produce the same bytes as the scalar kernels,
+// including for pixel counts that aren't a multiple of any vector width, and TREF_SIMD must select the variants.
+int main()
+{
+	using tref::detail::SimdLevel;
+
+	std::mt19937    rng{1};
+	const SimdLevel supported{tref::detail::detectSimdLevel()};
+	const SimdLevel levels[]{SimdLevel::SSE4_2, SimdLevel::AVX2, SimdLevel::AVX512};
+
+	// Random pixels of counts around the vector widths of 4, 8 and 16 pixels, with alpha often 0 or 255.
+	std::vector<std::vector<std::byte>> images;
+	for (const std::size_t count : {1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 32, 33, 47, 63, 64, 65, 127, 129, 1001}) {
+		std::vector<std::byte> pixels(count * 4);
+		std::ranges::generate(pixels, [&] { return static_cast<std::byte>(rng()); });
+		for (std::size_t i = 3; i < pixels.size(); i += 4) {
+			const auto choice{rng() % 4};
+			pixels[i] = choice == 0 ? std::byte{0} : choice == 1 ? std::byte{255} : pixels[i];
+		}
+		images.push_back(std::move(pixels));
+	}
+
+	// Every pair of color and alpha values, plus one pixel, for the rounding of premultiplication.
+	std::vector<std::byte> pairs;
+	for (unsigned int a = 0; a < 256; ++a) {
+		for (unsigned int c = 0; c < 256; ++c) {
+			for (const unsigned int value : {c, 255 - c, c ^ 0x5a, a}) {
+				pairs.push_back(static_cast<std::byte>(value));
+			}
+		}
+	}
+	pairs.insert(pairs.end(), {std::byte{200}, std::byte{100}, std::byte{1}, std::byte{129}});
+	images.push_back(std::move(pairs));
+
+	for (const SimdLevel level : levels) {
+		if (level <= supported) {
+			for (const std::vector<std::byte>& pixels : images) {
+				checkKernels(tref::detail::pixelKernels(level), pixels);
+			}
+		}
+	}
+
+	// TREF_SIMD selects a variant, capped to the supported ones, and is ignored when unknown.
+	const std::pair<const char*, SimdLevel> names[]{{"scalar", SimdLevel::SCALAR},
+													{"sse4.2", SimdLevel::SSE4_2},
+													{"avx2", SimdLevel::AVX2},
+													{"avx512", SimdLevel::AVX512},
+													{"neon", supported}};
+	for (const auto& [name, level] : names) {
+		setEnvironment("TREF_SIMD", name);
+		CHECK(tref::detail::selectSimdLevel() == std::min(level, supported));
+	}
+}
\ No newline at end of file
@@ -0,0 +1,101 @@
+#pragma once
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <sstream>
+#include <tref/tref.hpp>
+#include <vector>
+
+// Fails the test with a message if a condition doesn't hold.
+#define CHECK(condition)                                                                                               \
+	do {                                                                                                               \
+		if (!(condition)) {                                                                                            \
+			std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition);                        \
+			std::exit(EXIT_FAILURE);                                                                                   \
+		}                                                                                                              \
+	} while (false)
+
+namespace tref::test {
+	// Bitmap and glyphs of a generated font.
+	struct Atlas {
+		unsigned int           width, height;
+		std::vector<std::byte> pixels;
+		GlyphMap               glyphs;
+	};
+
+	// Generates a font whose glyphs are squares of random pixels laid out in rows, with a glyph for codepoint 0 that
+	// has no pixels. Glyphs that don't fit in the bitmap are left out.
+	inline Atlas makeAtlas(unsigned int width, unsigned int height, unsigned int glyphCount, unsigned int seed = 1,
+						   bool colored = false)
+	{
+		constexpr unsigned int SIZE{24};
+
+		std::mt19937 rng{seed};
+		Atlas        atlas{width, height, std::vector<std::byte>(std::size_t{width} * height * 4), {}};
+		unsigned int x{0}, y{0};
+		for (unsigned int i = 0; i < glyphCount; ++i) {
+			if (x + SIZE > width) {
+				x = 0;
+				y += SIZE;
+			}
+			if (y + SIZE > height) {
+				break;
+			}
+
+			const auto size{static_cast<std::uint16_t>(SIZE - 4)};
+			atlas.glyphs.emplace(0x20 + i * 3, Glyph{static_cast<std::uint16_t>(x), static_cast<std::uint16_t>(y), size,
+													 size, 1, -2, static_cast<std::int16_t>(SIZE)});
+			for (unsigned int py = y + 2; py < y + SIZE - 4; ++py) {
+				for (unsigned int px = x + 2; px < x + SIZE - 4; ++px) {
+					if (rng() % 3 == 0) {
+						continue;
+					}
+					std::byte* const pixel{&atlas.pixels[(std::size_t{py} * width + px) * 4]};
+					pixel[0] = pixel[1] = pixel[2] = std::byte{255};
+					if (colored) {
+						pixel[0] = static_cast<std::byte>(rng());
+						pixel[1] = static_cast<std::byte>(rng());
+					}
+					pixel[3] = static_cast<std::byte>(rng() % 4 == 0 ? 255 : rng());
+				}
+			}
+			x += SIZE;
+		}
+		atlas.glyphs.emplace(0, Glyph{});
+		return atlas;
+	}
+
+	// Encodes a font into a tref file.
+	inline std::vector<std::byte> encode(const Atlas& atlas, const EncodeOptions& options = {})
+	{
+		std::ostringstream os{std::ios::binary};
+		tref::encode(os, 20, atlas.glyphs, BitmapRef{atlas.pixels.data(), atlas.width, atlas.height}, options);
+		const std::string file{std::move(os).str()};
+		const std::byte*  data{reinterpret_cast<const std::byte*>(file.data())};
+		return {data, data + file.size()};
+	}
+
+	// Gets whether calling a function throws an exception of a given type.
+	template <class Exception, class Fn> bool throws(Fn&& fn)
+	{
+		try {
+			fn();
+		}
+		catch (const Exception&) {
+			return true;
+		}
+		return false;
+	}
+
+	// Reads a file from memory through a stream decoder, in chunks of a given size.
+	inline StreamDecoder streamDecoder(std::span<const std::byte> data, std::size_t chunkSize = 4096)
+	{
+		return StreamDecoder{[data](std::span<std::byte> buffer) mutable {
+								 const std::size_t size{std::min(buffer.size(), data.size())};
+								 std::copy_n(data.data(), size, buffer.data());
+								 data = data.subspan(size);
+								 return size;
+							 },
+							 chunkSize};
+	}
+} // namespace tref::test
\ No newline at end of file
@@ -16,10 +16,14 @@ FileEdit::FileEdit(const char* cpath)
 	if (cpath != nullptr) {
 		const std::filesystem::path path{cpath};
 
-		std::array<char, 4> buffer;
+		// Probing accepts every tref format version, so anything it rejects is imported as an image instead.
+		bool font;
 		try {
-			std::ifstream file{tr::openFileR(path, std::ios::binary)};
-			tr::readBinary(file, buffer);
+			tref::probeFile(path);
+			font = true;
+		}
+		catch (tref::DecodingError&) {
+			font = false;
 		}
 		catch (std::exception& err) {
 			const std::string message{std::format("Failed to open {}.", path.string())};
@@ -27,7 +31,7 @@ FileEdit::FileEdit(const char* cpath)
 			return;
 		}
 
-		if (std::string_view{buffer.data(), 4} == "TREF") {
+		if (font) {
 			std::optional<LoadResult> loadResult{loadFont(path)};
 			if (loadResult.has_value()) {
 				_file.emplace(*std::move(loadResult));
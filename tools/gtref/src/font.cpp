@@ -1,8 +1,27 @@
 #include "../include/font.hpp"
 #include <GL/glew.h>
+#include <cstdlib>
 #include <tinyfiledialogs.h>
 #include <tr/imgui.hpp>
 
+// Gets the sink tracing font loading and saving into the file named by the TREF_TRACE environment variable, if set.
+tref::TraceSink* traceSink() noexcept
+{
+	static const std::unique_ptr<tref::ChromeTraceSink> sink{[]() -> std::unique_ptr<tref::ChromeTraceSink> {
+		const char* path{std::getenv("TREF_TRACE")};
+		if (path == nullptr) {
+			return nullptr;
+		}
+		try {
+			return std::make_unique<tref::ChromeTraceSink>(path);
+		}
+		catch (tref::FileError&) {
+			return nullptr;
+		}
+	}()};
+	return sink.get();
+}
+
 std::optional<LoadResult> loadImage(const std::filesystem::path& path) noexcept
 {
 	try {
@@ -22,9 +41,9 @@ std::optional<LoadResult> loadImage(const std::filesystem::path& path) noexcept
 std::optional<LoadResult> loadFont(const std::filesystem::path& path) noexcept
 {
 	try {
-		std::ifstream           file{tr::openFileR(path, std::ios::binary)};
-		const std::vector<char> buffer{std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
-		const auto [lineSkip, glyphs, bitmap]{tref::decode(tr::rangeBytes(buffer))};
+		tref::DecodeOptions options;
+		options.trace = traceSink();
+		const auto [lineSkip, glyphs, bitmap]{tref::loadFile(path, tref::AccessHint::SEQUENTIAL, options)};
 		const tr::BitmapView image{bitmap.data(), {bitmap.width(), bitmap.height()}, tr::BitmapFormat::ARGB_8888};
 		return LoadResult{{lineSkip, std::move(glyphs)}, tr::Bitmap{image, tr::BitmapFormat::ARGB_8888}};
 	}
@@ -39,8 +58,10 @@ void saveFont(const std::filesystem::path& path, const Font& font, const tr::Bit
 {
 	try {
 		std::ofstream file{tr::openFileW(path, std::ios::binary)};
-		glm::uvec2    size{bitmap.size()};
-		tref::encode(file, font.lineSkip, font.glyphs, tref::BitmapRef{bitmap.data(), size.x, size.y});
+		glm::uvec2          size{bitmap.size()};
+		tref::EncodeOptions options;
+		options.trace = traceSink();
+		tref::encode(file, font.lineSkip, font.glyphs, tref::BitmapRef{bitmap.data(), size.x, size.y}, options);
 	}
 	catch (std::exception& err) {
 		const std::string message{std::format("Failed to save font to {}.", path.string())};
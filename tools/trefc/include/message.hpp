@@ -1,7 +1,13 @@
 #pragma once
 
 inline constexpr const char* HELP_MESSAGE{"tre Font Compiler (trefc) by TRDario.\n"
-										  "Usage: trefc [input file] [image file (BMP, PNG, JPEG)] [output file]\n"};
+										  "Usage: trefc [input file] [image file (BMP, PNG, JPEG)] [output file] [options]\n"
+										  "Options:\n"
+										  "  --level [level]       compression level: 1 to 12 for slower but smaller LZ4 HC output,\n"
+										  "                        -1 to -65537 for faster but larger output, 0 for the default\n"
+										  "  --tile [W]x[H]        split the bitmap into independently compressed tiles of W by H\n"
+										  "                        pixels, 0 standing for the full bitmap width or height\n"
+										  "  --trace [trace file]  write a Chrome trace of the encoding stages\n"};
 
 inline constexpr const char* INVALID_ARGUMENT_COUNT_MESSAGE{
 #ifdef TREFC_ANSI_COLORS
@@ -137,4 +143,34 @@ constexpr auto WRITING_FAILURE_MESSAGE{
 #ifdef TREFC_ANSI_COLORS
 	"\x1b[0m"
 #endif
-	" a writing operation failed on '{}'\n"};
\ No newline at end of file
+	" a writing operation failed on '{}'\n"};
+
+constexpr auto INVALID_OPTION_MESSAGE{
+#ifdef TREFC_ANSI_COLORS
+	"\x1b[1;91m"
+#endif
+	"error:"
+#ifdef TREFC_ANSI_COLORS
+	"\x1b[0m"
+#endif
+	" invalid option '{}'\n"};
+
+constexpr auto INVALID_LEVEL_MESSAGE{
+#ifdef TREFC_ANSI_COLORS
+	"\x1b[1;91m"
+#endif
+	"error:"
+#ifdef TREFC_ANSI_COLORS
+	"\x1b[0m"
+#endif
+	" invalid compression level '{}'\n"};
+
+constexpr auto INVALID_TILE_SIZE_MESSAGE{
+#ifdef TREFC_ANSI_COLORS
+	"\x1b[1;91m"
+#endif
+	"error:"
+#ifdef TREFC_ANSI_COLORS
+	"\x1b[0m"
+#endif
+	" invalid tile size '{}'\n"};
\ No newline at end of file
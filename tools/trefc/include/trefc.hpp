@@ -12,7 +12,8 @@ enum ErrorCode : int {
 	FILE_OPENING_FAILURE,
 	PARSING_FAILURE,
 	IMAGE_FAILURE,
-	WRITING_FAILURE
+	WRITING_FAILURE,
+	INVALID_OPTION
 };
 
 template <class T, class Error> using Expected = std::variant<T, Error>;
@@ -48,4 +49,5 @@ Expected<Bitmap, ErrorCode> loadBitmap(std::string_view path);
 
 ///
 
-ErrorCode writeToOutput(std::string_view path, const FontInfo& fontInfo, const Bitmap& bitmap);
\ No newline at end of file
+ErrorCode writeToOutput(std::string_view path, const FontInfo& fontInfo, const Bitmap& bitmap,
+						const tref::EncodeOptions& options);
\ No newline at end of file
@@ -1,20 +1,66 @@
 #include "../include/message.hpp"
 #include "../include/trefc.hpp"
+#include <charconv>
 
 int main(int argc, char* argv[])
 {
 	try {
-		switch (argc) {
-		case 1:
+		if (argc == 1) {
 			print(std::cout, HELP_MESSAGE);
 			return PRINTED_HELP;
-		case 4:
-			break;
-		default:
+		}
+		else if (argc < 4) {
 			print(std::cerr, INVALID_ARGUMENT_COUNT_MESSAGE, argc - 1);
 			return INVALID_ARGUMENT_COUNT;
 		}
 
+		tref::EncodeOptions                  options;
+		std::optional<tref::ChromeTraceSink> trace;
+		for (int i = 4; i < argc; ++i) {
+			const std::string_view option{argv[i]};
+			if (option == "--trace" && i + 1 < argc) {
+				try {
+					options.trace = &trace.emplace(argv[++i]);
+				}
+				catch (tref::FileError&) {
+					print(std::cerr, FILE_OPENING_FAILURE_MESSAGE, argv[i]);
+					return FILE_OPENING_FAILURE;
+				}
+			}
+			else if (option == "--level" && i + 1 < argc) {
+				// Positive levels select LZ4 HC, negative ones select accelerated compression.
+				const std::string_view value{argv[++i]};
+				int                    level;
+				const auto [end, ec]{std::from_chars(value.data(), value.data() + value.size(), level)};
+				if (ec != std::errc{} || end != value.data() + value.size() || level < -65537 || level > 12) {
+					print(std::cerr, INVALID_LEVEL_MESSAGE, value);
+					return INVALID_OPTION;
+				}
+				options.compression = level > 0   ? tref::Compression::HIGH
+									  : level < 0 ? tref::Compression::FAST
+												  : tref::Compression::DEFAULT;
+				options.level       = level > 0 ? level : -level;
+			}
+			else if (option == "--tile" && i + 1 < argc) {
+				// Tile sizes are given as WxH, where 0 stands for the full bitmap dimension.
+				const std::string_view value{argv[++i]};
+				const std::size_t      separator{value.find('x')};
+				const auto             parse{[](std::string_view str, unsigned int& out) {
+					const auto [end, ec]{std::from_chars(str.data(), str.data() + str.size(), out)};
+					return !str.empty() && ec == std::errc{} && end == str.data() + str.size();
+				}};
+				if (separator == std::string_view::npos || !parse(value.substr(0, separator), options.tileWidth) ||
+					!parse(value.substr(separator + 1), options.tileHeight)) {
+					print(std::cerr, INVALID_TILE_SIZE_MESSAGE, value);
+					return INVALID_OPTION;
+				}
+			}
+			else {
+				print(std::cerr, INVALID_OPTION_MESSAGE, option);
+				return INVALID_OPTION;
+			}
+		}
+
 		const Expected<FontInfo, ErrorCode> fontInfo{loadFontInfo(argv[1])};
 		if (holds_alternative<ErrorCode>(fontInfo)) {
 			return get<ErrorCode>(fontInfo);
@@ -23,7 +69,7 @@ int main(int argc, char* argv[])
 		if (holds_alternative<ErrorCode>(inputImage)) {
 			return get<ErrorCode>(inputImage);
 		}
-		return writeToOutput(argv[3], get<FontInfo>(fontInfo), get<Bitmap>(inputImage));
+		return writeToOutput(argv[3], get<FontInfo>(fontInfo), get<Bitmap>(inputImage), options);
 	}
 	catch (std::exception& err) {
 		print(std::cerr, UNHANDLED_EXCEPTION_MESSAGE, err.what());
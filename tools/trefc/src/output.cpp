@@ -2,7 +2,8 @@
 #include "../include/trefc.hpp"
 #include <fstream>
 
-ErrorCode writeToOutput(std::string_view path, const FontInfo& fontInfo, const Bitmap& bitmap)
+ErrorCode writeToOutput(std::string_view path, const FontInfo& fontInfo, const Bitmap& bitmap,
+						const tref::EncodeOptions& options)
 {
 	std::ofstream file{path.data(), std::ios::binary};
 	if (!file.is_open()) {
@@ -11,7 +12,7 @@ ErrorCode writeToOutput(std::string_view path, const FontInfo& fontInfo, const B
 	}
 
 	try {
-		tref::encode(file, fontInfo.lineSkip, fontInfo.glyphs, bitmap);
+		tref::encode(file, fontInfo.lineSkip, fontInfo.glyphs, bitmap, options);
 		if (!file) {
 			print(std::cerr, WRITING_FAILURE_MESSAGE, path);
 			return WRITING_FAILURE;